@@ -1,7 +1,5 @@
 // OthelloX.cpp : Defines the entry point for the console application.
 //
-#include <sched.h>
-
 #include "stdafx.h"
 #include "general.h"
 #include "board.h"
@@ -9,9 +7,18 @@
 #include "search.h"
 #include "timing.h"
 #include "processes.h"
+#include "tuning.h"
+#include "perft.h"
+#include "bench.h"
+#include "batch.h"
+#include "trace.h"
+#include "affinity.h"
 
 int _currentProcId = -1;
 int _slaveCount = -1;
+MPI_Comm _nodeComm;
+int _ranksOnNode = 1;
+int _mpiThreadSupport = MPI_THREAD_SINGLE;
 int _squaresPerProc;
 int _remainderSquares;
 board _sharedBoard;
@@ -27,7 +34,8 @@ long long _parallelEvalCompTime = 0;
 
 int main(int argc, char** argv)
 {
-	MPI_Init(&argc, &argv);
+	// Only the main thread calls MPI, the search threads don't
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &_mpiThreadSupport);
 
 	// Get the number of processes
 	int worldSize;
@@ -39,6 +47,105 @@ int main(int argc, char** argv)
 	// Who am I?(And who are you? Who, who... who, who..)
 	MPI_Comm_rank(MPI_COMM_WORLD, &_currentProcId); // Tell me who are YOU?
 
+	// Who shares my node?
+	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, _currentProcId, MPI_INFO_NULL, &_nodeComm);
+	MPI_Comm_size(_nodeComm, &_ranksOnNode);
+
+	// Offline weight tuning runs in the master process only
+	if (argc > 1 && string(argv[1]).compare(MODE_TUNE) == 0)
+	{
+		int status = 0;
+		if (_currentProcId == MASTER_ID)
+		{
+			if (argc < 5)
+			{
+				cout << "Usage: ./othello " << MODE_TUNE << " <path-to-dataset> <path-to-eval-params-file> <path-to-output-params-file> [threads]" << endl;
+				status = -1;
+			}
+			else if (!tuneWeights(argv[2], argv[3], argv[4], argc > 5 ? atoi(argv[5]) : 0))
+				status = -1;
+		}
+		MPI_Finalize();
+		return status;
+	}
+
+	// Move generator benchmark runs in the master process only
+	if (argc > 1 && string(argv[1]).compare(MODE_PERFT) == 0)
+	{
+		int status = 0;
+		if (_currentProcId == MASTER_ID)
+		{
+			board perftState;
+			if (argc < 4)
+			{
+				cout << "Usage: ./othello " << MODE_PERFT << " <path-to-initial-board-file> <depth>" << endl;
+				status = -1;
+			}
+			else if (!parseBoardFile(argv[2], perftState, _parameters))
+			{
+				LOG_ERR("Error while parsing board file " << argv[2]);
+				status = -1;
+			}
+			else if (!runPerft(perftState, atoi(argv[3]), true)) // The side to move is MAX
+				status = -1;
+			traceFinish(_currentProcId);
+		}
+		MPI_Finalize();
+		return status;
+	}
+
+	// Batch analysis runs in the master process only
+	if (argc > 1 && string(argv[1]).compare(MODE_BATCH) == 0)
+	{
+		int status = 0;
+		if (_currentProcId == MASTER_ID)
+		{
+			if (argc < 4)
+			{
+				cout << "Usage: ./othello " << MODE_BATCH << " <path-to-board-list> <path-to-eval-params-file> [threads]" << endl;
+				status = -1;
+			}
+			else if (!runBatch(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 0))
+				status = -1;
+		}
+		MPI_Finalize();
+		return status;
+	}
+
+	// The benchmark suite runs in every process
+	if (argc > 1 && string(argv[1]).compare(MODE_BENCH) == 0)
+	{
+		if (_currentProcId == MASTER_ID)
+		{
+			if (argc < 3)
+			{
+				cout << "Usage: ./othello " << MODE_BENCH << " <path-to-eval-params-file> [depth] [report-name]" << endl;
+				MPI_Abort(MPI_COMM_WORLD, -1);
+			}
+			if (!parseParamsFile(argv[2], _parameters))
+			{
+				LOG_ERR("Error while parsing parameters file " << argv[2]);
+				MPI_Abort(MPI_COMM_WORLD, -1);
+			}
+
+			// Searches run to a fixed depth, regardless of time and board limits
+			_parameters.maxDepth = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_DEPTH;
+			_parameters.maxBoards = INT_MAX;
+			_parameters.timeout = FLT_MAX;
+			// Boards are always evaluated in the searching process
+			_parameters.parallelSearch = true;
+		}
+		MPI_Bcast(&_parameters, sizeof(_parameters), MPI_BYTE, MASTER_ID, MPI_COMM_WORLD);
+		// Placed for the configured thread count, the threaded configurations with more threads share cores
+		initPlacement(_parameters.placement, _nodeComm, max(1, _parameters.threads));
+		cout << placementReport() << endl;
+		initTranspositionTable(_parameters.hashSize, _parameters.hugePages);
+
+		runBench(argc > 4 ? argv[4] : BENCH_DEFAULT_REPORT);
+		MPI_Finalize();
+		return 0;
+	}
+
 	board state;	// Our game board
 	float secondsForSearch;	// Store the fime for each search
 
@@ -70,12 +177,29 @@ int main(int argc, char** argv)
 	MPI_Bcast(&_parameters, sizeof(_parameters), MPI_BYTE, MASTER_ID, MPI_COMM_WORLD);
 	MPI_Bcast(&_M, 1, MPI_INT, MASTER_ID, MPI_COMM_WORLD);
 	MPI_Bcast(&_N, 1, MPI_INT, MASTER_ID, MPI_COMM_WORLD);
+	setBoardSize(_M, _N);
+
+	// Each process searches with its share of the cores of its node - with one process per node, all of them
+	if (_parameters.threads == 0)
+		_parameters.threads = max(1, (int)thread::hardware_concurrency() / _ranksOnNode);
+	if (_mpiThreadSupport < MPI_THREAD_FUNNELED)
+	{
+		if (_currentProcId == MASTER_ID && _parameters.threads != 1)
+			LOG_ERR("MPI doesn't support threads, searching with one thread per process");
+		_parameters.threads = 1;
+	}
+	if (_currentProcId == MASTER_ID && _parameters.threads != 1)
+		cout << _ranksOnNode << " processes on the master's node, " << _parameters.threads << " search threads per process" << endl;
+	initPlacement(_parameters.placement, _nodeComm, _parameters.threads);
+	initTranspositionTable(_parameters.hashSize, _parameters.hugePages);
+	if (_currentProcId == MASTER_ID && processTable() != nullptr)
+		cout << "Transposition table: " << tableMemoryReport(processTable()->memory) << endl;
 
 	// Maybe initialize weights for static evaluation
 	if(_parameters.useStaticEvaluation)
 	{
 		_squareWeights = board(_N * _M);
-		fillWeightsMatrix(_squareWeights);
+		fillWeightsMatrix(_squareWeights, _parameters);
 		if(_slaveCount > 0)
 		{
 			_squaresPerProc = (_N * _M) / worldSize;
@@ -98,6 +222,13 @@ int main(int argc, char** argv)
 
 	startTimer();
 
+	// The master sets the deadline for all processes' searches, as a wall clock time - each process' own timer started at a different time
+	double wallDeadline = wallSeconds() + moveTimeBudget(_parameters.timeout);
+	MPI_Bcast(&wallDeadline, 1, MPI_DOUBLE, MASTER_ID, MPI_COMM_WORLD);
+	setSearchDeadline(fromWallSeconds(wallDeadline));
+	if (_currentProcId == MASTER_ID)
+		cout << "Searching for " << moveTimeBudget(_parameters.timeout) << " s of the " << _parameters.timeout << " s timeout" << endl;
+
 	// If we only have one process or we've switched parallel search off, do what we would do in serial mode
 	if(_slaveCount < 2 || !_parameters.parallelSearch)
 	{
@@ -113,12 +244,15 @@ int main(int argc, char** argv)
 		{
 			cout << "Running search.." << endl;
 			_parameters.parallelSearch = false;
+			if (_parameters.useStaticEvaluation && _slaveCount >= 2 && _parameters.threads != 1)
+				LOG_ERR("The boards are split between the processes for evaluation, searching with one thread - Threads is ignored");
 			timePoint before = timeNow();
 			timePoint after;
 			vector<gameMove> nextMoves = treeSearch(state, _parameters.maxDepth, false, true); // Play for MAX
 			after = timeNow();
 			long long nsForSearch = nsBetween(before, after);
 			secondsForSearch = secondsElapsed();
+			_totalEvaluationTime = traceTotalNs(TRACE_EVAL); // Only measured when tracing is compiled in
 			
 			if (nextMoves.size() == 0)
 			{
@@ -131,23 +265,31 @@ int main(int argc, char** argv)
 			// saveBoardToFile(state, "../initialbrd.txt", _parameters.black);
 
 			cout << endl << printBoard(state, _parameters.black);
-			cout << "Number of boards assesed: " << _boardsEvaluated << endl;
-			cout << "Number of nodes pruned: " <<_nodesPruned << endl;
-			cout << "Estimated number of pruned nodes at maxDepth: " << _estMaxDepthPruned << endl;
-			cout << "Depth of boards: " << _maxDepthReached << endl;
-			cout << "Entire space: " << _entireSpaceCovered << endl;
+			cout << "Number of boards assesed: " << _searchContext.stats.boardsEvaluated << endl;
+			cout << "Number of nodes pruned: " << _searchContext.stats.nodesPruned << endl;
+			cout << "Estimated number of pruned nodes at maxDepth: " << _searchContext.stats.estMaxDepthPruned << endl;
+			cout << "Depth of boards: " << _searchContext.stats.maxDepthReached << endl;
+			cout << "Entire space: " << _searchContext.stats.entireSpaceCovered << endl;
 			cout << "Elapsed time in seconds: " << secondsForSearch << endl;
 			cout << "Elapsed time in seconds: " << (nsForSearch / BLN_DOUBLE) << endl;
-			cout << "Search without evaluation: " << (nsForSearch - _totalEvaluationTime) / BLN_DOUBLE << endl; 
-			cout << "Boards per second: " << _boardsEvaluated / secondsForSearch << endl;
-			cout << "Total evaluation time: " << _totalEvaluationTime / BLN_DOUBLE << endl;
+			cout << "Boards per second: " << _searchContext.stats.boardsEvaluated / secondsForSearch << endl;
 			cout << "Parallel evaluation comm time: " << _parallelEvalCommTime / BLN_DOUBLE << endl;
-			cout << "comm/totTime for evaluation: " << (double)_parallelEvalCommTime / (double)_totalEvaluationTime << endl;
-			cout << "Master spent ns on comp in parallel eval: " << (_totalEvaluationTime - _parallelEvalCommTime) / BLN_DOUBLE << endl;
+			if (traceEnabled())
+			{
+				cout << "Search without evaluation: " << (nsForSearch - _totalEvaluationTime) / BLN_DOUBLE << endl;
+				cout << "Total evaluation time: " << _totalEvaluationTime / BLN_DOUBLE << endl;
+				cout << "comm/totTime for evaluation: " << (_totalEvaluationTime > 0 ? (double)_parallelEvalCommTime / (double)_totalEvaluationTime : 0) << endl;
+				cout << "Master spent ns on comp in parallel eval: " << (_totalEvaluationTime - _parallelEvalCommTime) / BLN_DOUBLE << endl;
+			}
+			else
+			{
+				cout << "Evaluation time: only measured with tracing(make TRACE=1)" << endl;
+			}
 			cout << "Diff btw start and end of computation in master: " << _parallelEvalCompTime / BLN_DOUBLE << endl;
 
 			// Save stats to file
 			staticEvalStatsToFile(secondsForSearch);
+			traceFinish(_currentProcId);
 
 			// If we have slaves, tell them they'll get no more work
 			int8_t moreWork = false;
@@ -158,45 +300,44 @@ int main(int argc, char** argv)
 		}
 	}
 
-	
-	int sc_status;
-	cpu_set_t my_set;
-	unsigned short mask;
+	cout << placementReport() << endl;
 
-	memset(&my_set, 0, sizeof(my_set));
-	CPU_ZERO(&my_set);
-	sc_status = sched_getaffinity(0, sizeof(my_set), &my_set);
-	if (sc_status)
+	/*
+	Only the thread that called MPI_Init can reach the table shared by the slaves, and a slave with more than one search
+	thread leaves all of the searching to its pool - so the table is only made when every slave searches with one thread.
+	The thread counts may differ between nodes, and making the table is collective, so the processes agree on it first.
+	*/
+	if (_parameters.parallelSearch && _parameters.sharedHashSize > 0)
 	{
-		perror("sched_getaffinity");
-		return sc_status;
+		int threaded = _currentProcId != MASTER_ID && _parameters.threads != 1;
+		int anyThreaded = 0;
+		MPI_Allreduce(&threaded, &anyThreaded, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+		if (anyThreaded)
+		{
+			if (_currentProcId == MASTER_ID)
+				LOG_ERR("SharedHashSize needs Threads 1 - the slaves' search threads can't use the shared table, searching without it");
+			_parameters.sharedHashSize = 0;
+		}
 	}
-	
-	mask = 0;
-	
-	if (CPU_ISSET(0, &my_set)) mask |= 0x0001;
-	if (CPU_ISSET(1, &my_set)) mask |= 0x0002;
-	if (CPU_ISSET(2, &my_set)) mask |= 0x0004;
-	if (CPU_ISSET(3, &my_set)) mask |= 0x0008;
-	if (CPU_ISSET(4, &my_set)) mask |= 0x0010;
-	if (CPU_ISSET(5, &my_set)) mask |= 0x0020;
-	if (CPU_ISSET(6, &my_set)) mask |= 0x0040;
-	if (CPU_ISSET(7, &my_set)) mask |= 0x0080;
-	if (CPU_ISSET(8, &my_set)) mask |= 0x0100;
-	if (CPU_ISSET(9, &my_set)) mask |= 0x0200;
-	if (CPU_ISSET(10, &my_set)) mask |= 0x0400;
-	if (CPU_ISSET(11, &my_set)) mask |= 0x0800;
-	if (CPU_ISSET(12, &my_set)) mask |= 0x1000;
-	if (CPU_ISSET(13, &my_set)) mask |= 0x2000;
-	if (CPU_ISSET(14, &my_set)) mask |= 0x4000;
-	if (CPU_ISSET(15, &my_set)) mask |= 0x8000;
-	 
-	printf("Process %d is on processor mask 0x%x\n", _currentProcId, mask);
+
+	// Every process of a parallel search gets here, so the table shared by the slaves can be made now
+	if (_parameters.parallelSearch)
+		initDistributedTable(_parameters.sharedHashSize, _slaveCount, _parameters.hugePages);
+	if (_currentProcId == 0 && sharedTable() != nullptr && _parameters.hugePages != HUGE_PAGES_OFF)
+		cout << "Slave 0's part of the shared table: " << tableMemoryReport(sharedTable()->memory) << endl;
 
 	if(_currentProcId == MASTER_ID)
 	{
 		cout << "Master: " << _currentProcId  << " will run parallel search" << endl;
-		masterMain(state, _slaveCount);
+		searchSummary summary = masterMain(state, _slaveCount, true);
+		// Slaves that don't answer even when told to stop are hung, and would never reach the end - the answer is out, but the run failed
+		if (summary.abandonedJobs > 0)
+		{
+			LOG_ERR(summary.abandonedJobs << " slaves are hung and cannot be shut down, aborting the run");
+			traceFinish(_currentProcId);
+			cout << flush;
+			MPI_Abort(MPI_COMM_WORLD, -1);
+		}
 	}
 	else
 	{
@@ -212,7 +353,8 @@ int main(int argc, char** argv)
 		}
 	}
 
-	
+	freeDistributedTable();
+	traceFinish(_currentProcId);
 	MPI_Finalize();
 	return 0;
 
@@ -232,9 +374,9 @@ int main(int argc, char** argv)
 	// 	state = applyMove(state, nextMoves[0], true); // The computer player is MAX
 
 	// 	cout << endl << printBoard(state, _parameters.black);
-	// 	cout << "Number of boards assesed: " << _boardsEvaluated << endl;
-	// 	cout << "Depth of boards: " << _maxDepthReached << endl;
-	// 	cout << "Entire space: " << _entireSpaceCovered << endl;
+	// 	cout << "Number of boards assesed: " << _searchContext.stats.boardsEvaluated << endl;
+	// 	cout << "Depth of boards: " << _searchContext.stats.maxDepthReached << endl;
+	// 	cout << "Entire space: " << _searchContext.stats.entireSpaceCovered << endl;
 	// 	cout << "Elapsed time in seconds: " << secondsForSearch << endl;
 
 	// 	// Get, parse and apply player move
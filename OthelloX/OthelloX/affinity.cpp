@@ -0,0 +1,216 @@
+#include "stdafx.h"
+#include "affinity.h"
+
+#ifdef __linux__
+	#include <sched.h>
+#endif
+
+static placementPolicy _policy = PLACE_NONE;
+static vector<int> _processCpus;	// This process' cores - pool worker i is pinned to the i-th(wrapping around)
+static vector<int> _processNodes;	// The NUMA nodes they are on
+
+// The first line of a file, empty if there is no such file
+static string readFirstLine(const string &path)
+{
+	ifstream file(path);
+	string line;
+	if (!file.is_open() || !getline(file, line)) return "";
+	return line;
+}
+
+// Parse a list of CPUs or nodes in the format /sys uses: "0-3,8,10-11"
+static vector<int> parseIdList(const string &list)
+{
+	vector<int> ids;
+	stringstream stream(list);
+	string range;
+	while (getline(stream, range, ','))
+	{
+		try
+		{
+			size_t dash = range.find('-');
+			int first = stoi(range.substr(0, dash));
+			int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+			for (int id = first; id <= last; id++)
+				ids.push_back(id);
+		}
+		catch (const std::exception&)
+		{
+			// Whitespace at the end of the list
+		}
+	}
+	return ids;
+}
+
+// The reverse of parseIdList
+static string idListString(vector<int> ids)
+{
+	sort(ids.begin(), ids.end());
+	ids.erase(unique(ids.begin(), ids.end()), ids.end());
+	stringstream list;
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		int first = ids[i];
+		while (i + 1 < ids.size() && ids[i + 1] == ids[i] + 1) i++;
+		list << (list.tellp() > 0 ? "," : "") << first;
+		if (ids[i] != first) list << "-" << ids[i];
+	}
+	return list.str();
+}
+
+#ifdef __linux__
+
+// Which hyperthread of its core <cpu> is, 0 for the first
+static int siblingIndex(int cpu)
+{
+	vector<int> siblings = parseIdList(readFirstLine(PLACE_SYS_CPUS "/cpu" + to_string(cpu) + "/topology/thread_siblings_list"));
+	auto position = find(siblings.begin(), siblings.end(), cpu);
+	return position == siblings.end() ? 0 : position - siblings.begin();
+}
+
+static bool pinThread(const vector<int> &cpus)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu : cpus)
+		CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+void initPlacement(placementPolicy policy, MPI_Comm nodeComm, int threadsPerProcess)
+{
+	if (policy == PLACE_NONE) return;
+
+	// The cores any process of the node may run on
+	cpu_set_t allowed;
+	cpu_set_t nodeAllowed;
+	CPU_ZERO(&allowed);
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+	MPI_Allreduce(&allowed, &nodeAllowed, sizeof(cpu_set_t), MPI_BYTE, MPI_BOR, nodeComm);
+
+	// Their NUMA nodes - without NUMA information, they are all on one
+	vector<int> numaIds = parseIdList(readFirstLine(PLACE_SYS_NODES "/online"));
+	if (numaIds.size() == 0) numaIds.push_back(-1);
+	vector<vector<int>> numaCpus;
+	vector<int> cpuNode(CPU_SETSIZE, 0);
+	for (int numaId : numaIds)
+	{
+		vector<int> cpus;
+		if (numaId < 0)
+		{
+			for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+				cpus.push_back(cpu);
+		}
+		else
+		{
+			cpus = parseIdList(readFirstLine(PLACE_SYS_NODES "/node" + to_string(numaId) + "/cpulist"));
+		}
+		cpus.erase(remove_if(cpus.begin(), cpus.end(), [&nodeAllowed](int cpu) { return cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &nodeAllowed); }), cpus.end());
+		if (cpus.size() == 0) continue;
+
+		// A core's first hyperthread before any second one
+		vector<int> siblings(CPU_SETSIZE, 0);
+		for (int cpu : cpus)
+		{
+			siblings[cpu] = siblingIndex(cpu);
+			cpuNode[cpu] = max(0, numaId);
+		}
+		stable_sort(cpus.begin(), cpus.end(), [&siblings](int left, int right) { return siblings[left] < siblings[right]; });
+		numaCpus.push_back(cpus);
+	}
+	if (numaCpus.size() == 0)
+	{
+		LOG_ERR("No cores found to place the search threads on");
+		return;
+	}
+
+	int rank;
+	MPI_Comm_rank(nodeComm, &rank);
+
+	// The cores in the order the processes take them, and where this process starts
+	vector<int> order;
+	int first = rank * threadsPerProcess;
+	if (policy == PLACE_NUMA)
+	{
+		order = numaCpus[rank % numaCpus.size()];
+		first = (rank / numaCpus.size()) * threadsPerProcess;
+	}
+	else if (policy == PLACE_SCATTER)
+	{
+		size_t largest = 0;
+		for (const vector<int> &cpus : numaCpus)
+			largest = max(largest, cpus.size());
+		for (size_t i = 0; i < largest; i++)
+			for (const vector<int> &cpus : numaCpus)
+				if (i < cpus.size()) order.push_back(cpus[i]);
+	}
+	else
+	{
+		for (const vector<int> &cpus : numaCpus)
+			order.insert(order.end(), cpus.begin(), cpus.end());
+	}
+
+	vector<int> processCpus;
+	for (int t = 0; t < threadsPerProcess; t++)
+		processCpus.push_back(order[(first + t) % order.size()]);
+
+	// The main thread makes the process' tables, so it is placed before they are
+	if (!pinThread(processCpus))
+	{
+		LOG_ERR("Could not place process " << _currentProcId << " on cpus " << idListString(processCpus) << ": " << strerror(errno));
+		return;
+	}
+	_policy = policy;
+	_processCpus = processCpus;
+	_processNodes.clear();
+	for (int cpu : processCpus)
+		_processNodes.push_back(cpuNode[cpu]);
+}
+
+void placeWorker(int index)
+{
+	if (_processCpus.size() == 0) return;
+	if (!pinThread({ _processCpus[index % _processCpus.size()] }))
+		LOG_ERR("Could not place worker " << index << " of process " << _currentProcId << ": " << strerror(errno));
+}
+
+string placementReport()
+{
+	stringstream report;
+	report << "Process " << _currentProcId;
+	if (_processCpus.size() == 0)
+	{
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		sched_getaffinity(0, sizeof(allowed), &allowed);
+		vector<int> cpus;
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+		report << " is not placed, it may run on cpus " << idListString(cpus);
+		return report.str();
+	}
+
+	const char *policyNames[] = { "none", "compact", "scatter", "NUMA" };
+	report << " is placed " << policyNames[_policy] << " on cpus " << idListString(_processCpus)
+		   << ", NUMA node" << (idListString(_processNodes).find_first_of(",-") != string::npos ? "s " : " ") << idListString(_processNodes);
+	return report.str();
+}
+
+#else
+
+void initPlacement(placementPolicy policy, MPI_Comm nodeComm, int threadsPerProcess)
+{
+	if (policy != PLACE_NONE)
+		LOG_ERR("Thread placement is only supported on Linux, the threads are not placed");
+}
+
+void placeWorker(int index)
+{
+}
+
+string placementReport()
+{
+	return "Process " + to_string(_currentProcId) + " is not placed";
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef AFFINITY_H
+#define AFFINITY_H
+#endif // !AFFINITY_H
+
+#include "stdafx.h"
+#include "general.h"
+
+/*
+Placement of the search threads on the cores of a node(Linux only, elsewhere threads are left where the OS puts them)
+The processes on a node work out the same list of its cores - the ones any of them may run on, from the NUMA nodes
+in /sys, first hyperthreads first - and split it between them by the policy:
+	PLACE_COMPACT - each process takes the next <threads> cores of the list, filling a NUMA node before the next one
+	PLACE_SCATTER - as above, but the list alternates between the NUMA nodes
+	PLACE_NUMA    - each process takes one NUMA node(shared round-robin if there are more processes than nodes)
+The main thread of a process may run on any of the process' cores, search pool worker i is pinned to its i-th one.
+Memory is not bound - a thread's stack and thread_local tables, and the tables the main thread makes after placement,
+are first touched from their own cores and so land on the local NUMA node.
+For the policy to place the processes, mpirun must not bind them to fewer cores than they are given(--bind-to none).
+*/
+
+#define PLACE_SYS_NODES "/sys/devices/system/node"
+#define PLACE_SYS_CPUS "/sys/devices/system/cpu"
+
+/*
+Place this process' main thread and plan where its pool workers go
+Every process on a node must call this at the same time - they share their CPU masks over <nodeComm>
+threadsPerProcess - how many search threads each process on the node runs
+*/
+void initPlacement(placementPolicy policy, MPI_Comm nodeComm, int threadsPerProcess);
+
+// Pin the calling thread as worker <index> of the process' search pool - nothing if the process is not placed
+void placeWorker(int index);
+
+// Where this process' threads were placed, for the report
+string placementReport();
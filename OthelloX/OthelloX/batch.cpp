@@ -0,0 +1,103 @@
+#include "stdafx.h"
+#include "batch.h"
+#include "parsing.h"
+#include "context.h"
+#include "timing.h"
+
+// Analyse the boards of <files> until there are none left, taking the next one from <next>
+static void batchWorker(const vector<string> &files, const evalParams &params, atomic<size_t> &next, vector<batchResult> &results)
+{
+	for (size_t i = next++; i < files.size(); i = next++)
+	{
+		batchResult &result = results[i];
+		result.boardFile = files[i];
+
+		// Board files set the timeout and the color, so each board gets its own copy of the parameters
+		evalParams boardParams = params;
+		board state;
+		if (!parseBoardFile(files[i].c_str(), state, boardParams))
+		{
+			LOG_ERR("Error while parsing board file " << files[i]);
+			continue;
+		}
+		result.parsed = true;
+		result.rows = _M;
+		result.cols = _N;
+
+		// Contexts are large(the PV table), keep them off the thread's stack
+		unique_ptr<searchContext> ctx(new searchContext());
+		initContext(*ctx, boardParams, _M, _N);
+
+		timePoint start = timeNow();
+		treeSearch(*ctx, state, boardParams.maxDepth, false, true);
+		result.seconds = secondsSince(start);
+		result.boardsEvaluated = ctx->stats.boardsEvaluated;
+		if (ctx->rootMoves.size() > 0)
+			result.best = ctx->rootMoves[0];
+		else
+			result.best.move = PASS_MOVE;
+	}
+}
+
+bool runBatch(const char *listFile, const char *paramsFile, int threadCount)
+{
+	evalParams params;
+	if (!parseParamsFile(paramsFile, params))
+	{
+		LOG_ERR("Error while parsing parameters file " << paramsFile);
+		return false;
+	}
+	// Boards are evaluated in the searching thread
+	params.parallelSearch = true;
+	initTranspositionTable(params.hashSize, params.hugePages);
+	if (processTable() != nullptr)
+		cout << "Transposition table: " << tableMemoryReport(processTable()->memory) << endl;
+
+	ifstream in(listFile);
+	if (!in)
+	{
+		LOG_ERR("Cannot open file for reading: " << listFile);
+		return false;
+	}
+	vector<string> files;
+	string line;
+	while (getline(in, line))
+	{
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (line.size() > 0) files.push_back(line);
+	}
+
+	if (threadCount <= 0)
+		threadCount = max(1u, thread::hardware_concurrency());
+	threadCount = max(1, min(threadCount, (int)files.size()));
+
+	cout << "Analysing " << files.size() << " boards with " << threadCount << " threads" << endl;
+
+	timePoint start = timeNow();
+	vector<batchResult> results(files.size());
+	atomic<size_t> next(0);
+	vector<thread> workers;
+	for (int t = 0; t < threadCount; t++)
+		workers.push_back(thread(batchWorker, cref(files), cref(params), ref(next), ref(results)));
+	for (thread &worker : workers)
+		worker.join();
+
+	bool allParsed = true;
+	for (const batchResult &result : results)
+	{
+		if (!result.parsed)
+		{
+			cout << result.boardFile << ": not analysed" << endl;
+			allParsed = false;
+			continue;
+		}
+		cout << result.boardFile << " (" << result.rows << "x" << result.cols << "): " << moveString(result.best.move)
+			 << " with a score of " << result.best.value << ", " << result.boardsEvaluated << " boards in "
+			 << result.seconds << "s";
+		if (result.best.pv.size() > 0) cout << ", line: " << lineString(result.best.pv);
+		cout << endl;
+	}
+	cout << "Batch took " << secondsSince(start) << "s" << endl;
+
+	return allParsed;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#ifndef BATCH_H
+#define BATCH_H
+#endif // !BATCH_H
+
+#include "stdafx.h"
+#include "general.h"
+#include "board.h"
+#include "search.h"
+
+// Command line mode for batch analysis
+#define MODE_BATCH "batch"
+
+// The result of analysing one board of a batch
+struct batchResult
+{
+	string boardFile;
+	bool parsed = false;
+	int rows = 0;
+	int cols = 0;
+	valueMove best;				// Best root move(move.x < 0 if there are no moves)
+	int boardsEvaluated = 0;
+	float seconds = 0;
+};
+
+/*
+Search every board file listed in <listFile>(one path per line) with the parameters in <paramsFile>,
+on <threadCount> threads(0 - one per core). Boards can have different sizes - every search has its own context.
+Prints the best move of each board, in list order. Runs in one process.
+*/
+bool runBatch(const char *listFile, const char *paramsFile, int threadCount);
@@ -0,0 +1,152 @@
+#include "stdafx.h"
+#include "bench.h"
+#include "search.h"
+#include "evaluate.h"
+#include "processes.h"
+#include "timing.h"
+
+// Fixed positions, so that reports from different builds and machines can be compared
+static const benchPosition _benchPositions[] = {
+	{ "start8x8", 8, 8, "---------------------------OX------XO---------------------------" },
+	{ "open8x8", 8, 8, "----------X-------X-XXX---XXO---OOOOO-------OO--------O---------" },
+	{ "mid8x8", 8, 8, "---------O---O----OOOO-O-XXOXOOX--OXXOX---O-XXX---OXX-O-----X---" },
+	{ "late8x8", 8, 8, "OX-X-XX-OOXX-XX-XXXX-XX-O-OOXXX--OOOXOOO--OO-OOX--X-OOO--X------" },
+	{ "end8x8", 8, 8, "O-X---O-XXXX-O--XXXXOOOOXXXOXO-OXXXXXOOOXXXXOOOOO-XOOOOO--OOOOOO" },
+	{ "mid6x6", 6, 6, "-X------X-O--XXO---XOO--XOX---------" },
+	{ "mid10x10", 10, 10, "------------------X-----O--X----XOOXX-----OXXXX----OOOOX-------O--X---------------------------------" }
+};
+#define BENCH_POSITION_COUNT (int)(sizeof(_benchPositions) / sizeof(_benchPositions[0]))
+
+// Set up the board size, weights and board for a position
+void loadBenchPosition(const benchPosition &pos, board &state)
+{
+	setBoardSize(pos.rows, pos.columns);
+	makeEmptyBoard(state);
+	for (int i = 0; i < _M * _N; i++)
+	{
+		if (pos.squares[i] == 'X') boardAssign(state, i, BRD_MAX_DISC);
+		else if (pos.squares[i] == 'O') boardAssign(state, i, BRD_MIN_DISC);
+	}
+
+	_squareWeights = board(_N * _M);
+	fillWeightsMatrix(_squareWeights, _parameters);
+}
+
+// Every bench search starts with an empty table, or the later configurations would find the positions already searched
+void clearBenchTable()
+{
+	if (processTable() != nullptr) clearTable(*processTable());
+}
+
+searchSummary serialBenchSearch(const board &state)
+{
+	clearBenchTable();
+	startTimer();
+	timePoint before = timeNow();
+	vector<gameMove> moves = treeSearch(state, _parameters.maxDepth, false, true);
+	long long ns = nsBetween(before, timeNow());
+
+	searchSummary summary;
+	summary.timeNs = ns;
+	summary.boardsEvaluated = _searchContext.stats.boardsEvaluated;
+	summary.nodesPruned = _searchContext.stats.nodesPruned;
+	summary.estMaxDepthPruned = _searchContext.stats.estMaxDepthPruned;
+	summary.maxDepthReached = _searchContext.stats.maxDepthReached;
+	summary.entireSpace = _searchContext.stats.entireSpaceCovered;
+	summary.jobCount = 1;
+	summary.loadImbalance = 1;
+	summary.bestMove = moves.size() > 0 ? moves[0] : gameMove{-1, -1};
+	return summary;
+}
+
+void writeBenchReport(const vector<benchResult> &results, const char *reportName)
+{
+	string csvName = string(reportName) + ".csv";
+	string jsonName = string(reportName) + ".json";
+	ofstream csv(csvName, std::ofstream::trunc);
+	ofstream json(jsonName, std::ofstream::trunc);
+	if (!csv || !json)
+	{
+		LOG_ERR("Cannot open benchmark report files for writing: " << csvName << ", " << jsonName);
+		return;
+	}
+
+	csv << "configuration, position, boardSize, procCount, depth, boardsEvaluated, timeSec, boardsPerSec, nodesPruned, estPruneRatio, jobCount, loadImbalance, bestMove" << endl;
+	json << "{" << endl << "  \"procCount\": " << _slaveCount + 1 << "," << endl << "  \"depth\": " << _parameters.maxDepth << ","
+		 << endl << "  \"results\": [" << endl;
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const benchResult &r = results[i];
+		double seconds = r.summary.timeNs / BLN_DOUBLE;
+		double bps = seconds > 0 ? r.summary.boardsEvaluated / seconds : 0;
+		double pruneRatio = r.summary.estMaxDepthPruned / pow(AVG_BRANCH_FACTOR, _parameters.maxDepth);
+
+		csv << r.configuration << ", " << r.position << ", " << r.boardSize << ", " << _slaveCount + 1 << ", " << _parameters.maxDepth << ", "
+			<< r.summary.boardsEvaluated << ", " << seconds << ", " << bps << ", " << r.summary.nodesPruned << ", " << pruneRatio << ", "
+			<< r.summary.jobCount << ", " << r.summary.loadImbalance << ", " << moveString(r.summary.bestMove) << endl;
+
+		json << "    { \"configuration\": \"" << r.configuration << "\", \"position\": \"" << r.position << "\", \"boardSize\": " << r.boardSize
+			 << ", \"boardsEvaluated\": " << r.summary.boardsEvaluated << ", \"timeSec\": " << seconds << ", \"boardsPerSec\": " << bps
+			 << ", \"nodesPruned\": " << r.summary.nodesPruned << ", \"estPruneRatio\": " << pruneRatio << ", \"jobCount\": " << r.summary.jobCount
+			 << ", \"loadImbalance\": " << r.summary.loadImbalance << ", \"bestMove\": \"" << moveString(r.summary.bestMove) << "\" }"
+			 << (i + 1 < results.size() ? "," : "") << endl;
+	}
+
+	json << "  ]" << endl << "}" << endl;
+	cout << "Benchmark report written to " << csvName << " and " << jsonName << endl;
+}
+
+void runBench(const char *reportName)
+{
+	vector<benchResult> results;
+	board state;
+
+	// Serial search, in the master only
+	if (_currentProcId == MASTER_ID)
+	{
+		_parameters.threads = 1;
+		for (int p = 0; p < BENCH_POSITION_COUNT; p++)
+		{
+			loadBenchPosition(_benchPositions[p], state);
+			cout << "serial " << _benchPositions[p].name << endl;
+			results.push_back({ "serial", _benchPositions[p].name, _M * _N, serialBenchSearch(state) });
+		}
+	}
+
+	// Threaded search of the root moves, in the master only
+	if (_currentProcId == MASTER_ID)
+	{
+		_parameters.threads = max(BENCH_MIN_THREADS, (int)thread::hardware_concurrency());
+		for (int p = 0; p < BENCH_POSITION_COUNT; p++)
+		{
+			loadBenchPosition(_benchPositions[p], state);
+			cout << "threaded " << _benchPositions[p].name << endl;
+			results.push_back({ "threaded", _benchPositions[p].name, _M * _N, serialBenchSearch(state) });
+		}
+		_parameters.threads = 1;
+	}
+
+	// Parallel search, every process takes part
+	if (_slaveCount > 0)
+	{
+		for (int p = 0; p < BENCH_POSITION_COUNT; p++)
+		{
+			loadBenchPosition(_benchPositions[p], state);
+			clearBenchTable();
+			startTimer();
+			if (_currentProcId == MASTER_ID)
+			{
+				cout << "mpi " << _benchPositions[p].name << endl;
+				results.push_back({ "mpi", _benchPositions[p].name, _M * _N, masterMain(state, _slaveCount, false) });
+			}
+			else
+			{
+				slaveMain(MASTER_ID, _currentProcId);
+			}
+		}
+	}
+
+	if (_currentProcId == MASTER_ID)
+		writeBenchReport(results, reportName);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#ifndef BENCH_H
+#define BENCH_H
+#endif // !BENCH_H
+
+#include "stdafx.h"
+#include "general.h"
+#include "board.h"
+#include "stats.h"
+
+// Command line mode for the benchmark suite
+#define MODE_BENCH "bench"
+
+#define BENCH_DEFAULT_DEPTH 6
+#define BENCH_DEFAULT_REPORT "bench" // Written to bench.csv and bench.json
+#define BENCH_MIN_THREADS 2 // The threaded configuration uses a thread per core, but at least this many
+
+// A position from the built-in benchmark set
+struct benchPosition
+{
+	const char *name;
+	int rows;
+	int columns;
+	const char *squares;	// Row by row: X for the side to move(MAX), O for the opponent, - for empty squares
+};
+
+// The result of searching one position in one configuration
+struct benchResult
+{
+	string configuration;
+	string position;
+	int boardSize;
+	searchSummary summary;
+};
+
+/*
+Search every position of the built-in set to a fixed depth - serially, with the root moves split between threads
+and with MPI parallel search(when there are slaves),
+and write one report to <reportName>.csv and <reportName>.json
+Must be called by all processes, after the parameters have been broadcast
+*/
+void runBench(const char *reportName);
@@ -0,0 +1,361 @@
+#pragma once
+#ifndef BITBOARD_H
+#define BITBOARD_H
+#endif // !BITBOARD_H
+
+#include "stdafx.h"
+#include "general.h"
+#include "boardcore.h"
+
+#include <stdint.h>
+
+/*
+Multi-word bitboards for boards of up to 16x16 squares.
+A board of _M x _N squares is stored in W 64-bit words, square (y, x) in bit y * _N + x, so that bits
+are in the same order as the squares of a board vector. Shifting by a direction moves every disc one
+square in that direction - the direction masks drop the discs that would wrap around to the other side
+of the board, and the full mask drops the ones that would fall off the top or the bottom.
+*/
+
+#define BB_MAX_SIDE 16
+#define BB_DIRECTIONS 8
+
+template<int W>
+struct bitBoard
+{
+	uint64_t w[W];
+};
+
+// Shift amounts and masks for the current board size
+template<int W>
+struct bitGeometry
+{
+	int shift[BB_DIRECTIONS];			// Positive - towards higher square indices
+	bitBoard<W> mask[BB_DIRECTIONS];	// Squares a disc can land on after a shift in this direction
+	int maxRun;							// The longest line of discs that can be flanked
+	vector<bitBoard<W>> lines[RAY_AXES];	// Every line of squares along each axis
+	bitBoard<W> ends[RAY_AXES];			// Squares at either end of a line along each axis
+};
+
+// The geometry for this thread's board size, set by setBoardSize
+template<int W>
+inline const bitGeometry<W> *&bitGeoPtr()
+{
+	static thread_local const bitGeometry<W> *geometry = nullptr;
+	return geometry;
+}
+
+template<int W>
+inline const bitGeometry<W> &bitGeo()
+{
+	return *bitGeoPtr<W>();
+}
+
+template<int W>
+inline bitBoard<W> bbAnd(const bitBoard<W> &a, const bitBoard<W> &b)
+{
+	bitBoard<W> r;
+	for (int i = 0; i < W; i++) r.w[i] = a.w[i] & b.w[i];
+	return r;
+}
+
+template<int W>
+inline bitBoard<W> bbOr(const bitBoard<W> &a, const bitBoard<W> &b)
+{
+	bitBoard<W> r;
+	for (int i = 0; i < W; i++) r.w[i] = a.w[i] | b.w[i];
+	return r;
+}
+
+template<int W>
+inline bool bbEmpty(const bitBoard<W> &a)
+{
+	uint64_t any = 0;
+	for (int i = 0; i < W; i++) any |= a.w[i];
+	return any == 0;
+}
+
+template<int W>
+inline bitBoard<W> bbZero()
+{
+	bitBoard<W> r;
+	for (int i = 0; i < W; i++) r.w[i] = 0;
+	return r;
+}
+
+template<int W>
+inline void bbSet(bitBoard<W> &a, int square)
+{
+	a.w[square >> 6] |= 1ULL << (square & 63);
+}
+
+// Shift by <s> squares, 0 < |s| < 64 - enough for boards up to 16 squares wide
+template<int W>
+inline bitBoard<W> bbShift(const bitBoard<W> &a, int s)
+{
+	bitBoard<W> r;
+	if (s > 0)
+	{
+		r.w[0] = a.w[0] << s;
+		for (int i = 1; i < W; i++) r.w[i] = (a.w[i] << s) | (a.w[i - 1] >> (64 - s));
+	}
+	else
+	{
+		s = -s;
+		for (int i = 0; i < W - 1; i++) r.w[i] = (a.w[i] >> s) | (a.w[i + 1] << (64 - s));
+		r.w[W - 1] = a.w[W - 1] >> s;
+	}
+	return r;
+}
+
+// Shift every disc one square in direction <d>, dropping the ones that leave the board
+template<int W>
+inline bitBoard<W> bbStep(const bitBoard<W> &a, int d)
+{
+	const bitGeometry<W> &geo = bitGeo<W>();
+	return bbAnd(bbShift(a, geo.shift[d]), geo.mask[d]);
+}
+
+// Compute the shifts and masks for a <rows> x <cols> board
+template<int W>
+void initBitGeometry(bitGeometry<W> &geo, int rows, int cols)
+{
+	int d = 0;
+	for (int i = -1; i <= 1; i++)
+	{
+		for (int j = -1; j <= 1; j++)
+		{
+			if (i == 0 && j == 0) continue;
+
+			geo.shift[d] = i * cols + j;
+			geo.mask[d] = bbZero<W>();
+			for (int y = 0; y < rows; y++)
+			{
+				for (int x = 0; x < cols; x++)
+				{
+					// A disc moving east can't land on the first column, one moving west can't land on the last
+					if ((j == 1 && x == 0) || (j == -1 && x == cols - 1)) continue;
+					bbSet(geo.mask[d], y * cols + x);
+				}
+			}
+			d++;
+		}
+	}
+	geo.maxRun = max(rows, cols) - 2;
+
+	// Lines along each axis, keyed by the row, the column, or the column minus/plus the row
+	for (int a = 0; a < RAY_AXES; a++)
+	{
+		geo.lines[a] = vector<bitBoard<W>>(rows + cols, bbZero<W>());
+		geo.ends[a] = bbZero<W>();
+	}
+	for (int y = 0; y < rows; y++)
+	{
+		for (int x = 0; x < cols; x++)
+		{
+			int square = y * cols + x;
+			bbSet(geo.lines[0][y], square);
+			bbSet(geo.lines[1][x], square);
+			bbSet(geo.lines[2][x - y + rows], square);
+			bbSet(geo.lines[3][x + y], square);
+
+			if (x == 0 || x == cols - 1) bbSet(geo.ends[0], square);
+			if (y == 0 || y == rows - 1) bbSet(geo.ends[1], square);
+			if (x == 0 || x == cols - 1 || y == 0 || y == rows - 1)
+			{
+				bbSet(geo.ends[2], square);
+				bbSet(geo.ends[3], square);
+			}
+		}
+	}
+}
+
+// Build the bitboards of <me> and <-me> discs from a board array
+template<int W>
+inline void toBitBoards(const piece *state, int squares, piece me, bitBoard<W> &mine, bitBoard<W> &theirs)
+{
+	mine = bbZero<W>();
+	theirs = bbZero<W>();
+	for (int i = 0; i < squares; i++)
+	{
+		if (state[i] == me) bbSet(mine, i);
+		else if (state[i] == -me) bbSet(theirs, i);
+	}
+}
+
+// Squares where <mine> can move
+template<int W>
+bitBoard<W> bbMoves(const bitBoard<W> &mine, const bitBoard<W> &theirs)
+{
+	const bitGeometry<W> &geo = bitGeo<W>();
+	bitBoard<W> empty = bbZero<W>();
+	bitBoard<W> moves = bbZero<W>();
+
+	// Every valid square(all of them are in the masks of the diagonal directions) that is not taken
+	bitBoard<W> full = bbOr(geo.mask[0], geo.mask[2]);
+	for (int i = 0; i < W; i++) empty.w[i] = full.w[i] & ~(mine.w[i] | theirs.w[i]);
+
+	for (int d = 0; d < BB_DIRECTIONS; d++)
+	{
+		// Runs of their discs next to one of mine
+		bitBoard<W> run = bbAnd(bbStep(mine, d), theirs);
+		for (int k = 1; k < geo.maxRun; k++)
+			run = bbOr(run, bbAnd(bbStep(run, d), theirs));
+		moves = bbOr(moves, bbAnd(bbStep(run, d), empty));
+	}
+
+	return moves;
+}
+
+// Discs flipped by <mine> moving to <square>
+template<int W>
+bitBoard<W> bbFlips(const bitBoard<W> &mine, const bitBoard<W> &theirs, int square)
+{
+	bitBoard<W> flips = bbZero<W>();
+	bitBoard<W> start = bbZero<W>();
+	bbSet(start, square);
+
+	for (int d = 0; d < BB_DIRECTIONS; d++)
+	{
+		bitBoard<W> line = bbZero<W>();
+		bitBoard<W> cur = bbStep(start, d);
+		while (!bbEmpty(bbAnd(cur, theirs)))
+		{
+			line = bbOr(line, cur);
+			cur = bbStep(cur, d);
+		}
+		if (!bbEmpty(bbAnd(cur, mine))) flips = bbOr(flips, line);
+	}
+
+	return flips;
+}
+
+template<int W>
+inline bool bbEqual(const bitBoard<W> &a, const bitBoard<W> &b)
+{
+	uint64_t diff = 0;
+	for (int i = 0; i < W; i++) diff |= a.w[i] ^ b.w[i];
+	return diff == 0;
+}
+
+template<int W>
+inline int bbCount(const bitBoard<W> &a)
+{
+	int count = 0;
+	for (int i = 0; i < W; i++) count += __builtin_popcountll(a.w[i]);
+	return count;
+}
+
+/*
+One step of the stability fixpoint for one colour - the discs that are stable given the stable discs found so far
+A disc is stable if along each of the four axes its line is full, or it is next to the end of the
+line or to a stable disc of its own colour, or it is between two stable discs of the other colour.
+full - for each axis, the squares on full lines
+*/
+template<int W>
+bitBoard<W> bbStableStep(const bitBoard<W> &discs, const bitBoard<W> &stable, const bitBoard<W> &opponentStable, const bitBoard<W> *full)
+{
+	const bitGeometry<W> &geo = bitGeo<W>();
+	bitBoard<W> next = discs;
+	for (int a = 0; a < RAY_AXES; a++)
+	{
+		bitBoard<W> safe = bbOr(bbOr(full[a], geo.ends[a]),
+								bbOr(bbStep(stable, _axisDirections[a][0]), bbStep(stable, _axisDirections[a][1])));
+		safe = bbOr(safe, bbAnd(bbStep(opponentStable, _axisDirections[a][0]), bbStep(opponentStable, _axisDirections[a][1])));
+		next = bbAnd(next, safe);
+	}
+	return next;
+}
+
+/*
+Stable discs of both colours - starting with none, add the discs that satisfy the rules until nothing changes
+The colours are done together, as each one's stable discs can make discs of the other stable.
+Like stableDiscsT, a lower bound on the discs that can never be flipped.
+*/
+template<int W>
+void bbStableBoth(const bitBoard<W> &maxDiscs, const bitBoard<W> &minDiscs, bitBoard<W> &maxStable, bitBoard<W> &minStable)
+{
+	const bitGeometry<W> &geo = bitGeo<W>();
+	bitBoard<W> occupied = bbOr(maxDiscs, minDiscs);
+
+	bitBoard<W> full[RAY_AXES];
+	for (int a = 0; a < RAY_AXES; a++)
+	{
+		full[a] = bbZero<W>();
+		for (const bitBoard<W> &line : geo.lines[a])
+		{
+			if (bbEqual(bbAnd(line, occupied), line)) full[a] = bbOr(full[a], line);
+		}
+	}
+
+	maxStable = bbZero<W>();
+	minStable = bbZero<W>();
+	while (true)
+	{
+		bitBoard<W> maxNext = bbStableStep(maxDiscs, maxStable, minStable, full);
+		bitBoard<W> minNext = bbStableStep(minDiscs, minStable, maxNext, full);
+		if (bbEqual(maxNext, maxStable) && bbEqual(minNext, minStable)) return;
+		maxStable = maxNext;
+		minStable = minNext;
+	}
+}
+
+// Call <f>(square) for every set bit, lowest first
+template<int W, typename F>
+inline void bbForEach(const bitBoard<W> &a, F f)
+{
+	for (int i = 0; i < W; i++)
+	{
+		uint64_t word = a.w[i];
+		while (word)
+		{
+			f(i * 64 + __builtin_ctzll(word));
+			word &= word - 1;
+		}
+	}
+}
+
+/*
+Kernels with the same interface as the ones in boardcore.h
+W - words per bitboard, M, N - board dimensions(0 if only known at runtime)
+*/
+
+template<int W, int M, int N>
+bool isValidMoveBB(const piece *state, int y, int x, piece me)
+{
+	const int cols = boardDims<M, N>::cols();
+	if (state[y * cols + x] != BRD_FREE) return false;
+
+	bitBoard<W> mine, theirs;
+	toBitBoards(state, boardDims<M, N>::rows() * cols, me, mine, theirs);
+	return !bbEmpty(bbFlips(mine, theirs, y * cols + x));
+}
+
+template<int W, int M, int N>
+void getMovesBB(const piece *state, piece me, vector<gameMove> &moves)
+{
+	const int cols = boardDims<M, N>::cols();
+	bitBoard<W> mine, theirs;
+	toBitBoards(state, boardDims<M, N>::rows() * cols, me, mine, theirs);
+	bbForEach(bbMoves(mine, theirs), [&](int square) { moves.push_back({ square % cols, square / cols }); });
+}
+
+template<int W, int M, int N>
+void applyMoveBB(piece *state, int y, int x, piece me)
+{
+	const int cols = boardDims<M, N>::cols();
+	bitBoard<W> mine, theirs;
+	toBitBoards(state, boardDims<M, N>::rows() * cols, me, mine, theirs);
+	state[y * cols + x] = me;
+	bbForEach(bbFlips(mine, theirs, y * cols + x), [&](int square) { state[square] = me; });
+}
+
+template<int W, int M, int N>
+void stableDiscsBB(const piece *state, int &maxStable, int &minStable)
+{
+	bitBoard<W> maxDiscs, minDiscs, maxS, minS;
+	toBitBoards(state, boardDims<M, N>::rows() * boardDims<M, N>::cols(), BRD_MAX_DISC, maxDiscs, minDiscs);
+	bbStableBoth(maxDiscs, minDiscs, maxS, minS);
+	maxStable = bbCount(maxS);
+	minStable = bbCount(minS);
+}
@@ -1,58 +1,22 @@
 #include "stdafx.h"
 #include "board.h"
+#include "trace.h"
+#include "kernels.h"
 
 #include <assert.h>
 
 // Board height
-int _M;
+thread_local int _M;
 // Board width
-int _N;
-
-bool maybeFlipInDirection(board &state, int y, int x, signed char i, signed char j)
-{
-	if (y < 0 || y >= _M || x < 0 || x >= _N || boardAt(state, y, x) == BRD_FREE) return false;
-	if (boardAt(state, y, x) == BRD_MAX_DISC) return true;
-
-	// Flip current disc
-	boardAssign(state, y, x, BRD_MAX_DISC);
-	// If it turns out we don't have to flip discs in this direction, flip it back
-	bool haveToFlip = maybeFlipInDirection(state, y + i, x + j, i, j);
-	if (!haveToFlip)
-	{
-		boardAssign(state, y, x, BRD_MIN_DISC);
-		return false;
-	}
-
-	// If we got to here, we're flippin'
-	return true;
-}
+thread_local int _N;
 
 board applyMove(const board &state, const gameMove &move, bool max)
 {
+	TRACE_SCOPE(TRACE_MAKE_MOVE);
 	assert(isValidMove(max ? state : flipAll(state), move.y, move.x));
 
 	board result = board(state);
-
-	// The resulting board for a MIN move can be obtained by flipping all discs,
-	// making a MAX move and then flipping them all again
-	if (!max) result = flipAll(result);
-	
-	// Put disc down
-	boardAssign(result, move.y, move.x, BRD_MAX_DISC);
-
-	// Check all 8 directions
-	for (int i = -1; i <= 1; i++)
-	{
-		for (int j = -1; j <= 1; j++)
-		{
-			// Do not check current square
-			if (i == j && j == 0) continue;
-
-			// If the next disc in the current direction is MIN, we want to check if we have to flip in this direction
-			if (move.y + i >= 0 && move.y + i < _M && move.x + j >= 0 && move.x + j < _N && boardAt(result, move.y + i, move.x + j) == BRD_MIN_DISC) maybeFlipInDirection(result, move.y + i, move.x + j, i, j);
-		}
-	}
-	if (!max) return flipAll(result);
+	_kernels.applyMove(&result.front(), move.y, move.x, max ? BRD_MAX_DISC : BRD_MIN_DISC);
 	return result;
 }
 
@@ -75,71 +39,20 @@ board flipAll(const board &brd)
 
 bool isValidMove(const board &state, int y, int x)
 {
-	// We cannot put a disc on top of another
-	if (boardAt(state, y, x) != BRD_FREE) return false;
-
-	// Move in every direction until we're seeing a MIN disc, if we see a MAX disc after we've seen at least one MIN disc, return true
-	for (int i = -1; i <= 1; i++)
-	{
-		for (int j = -1; j <= 1; j++)
-		{
-			// Do not check current square
-			if (i == j && j == 0) continue;
-
-			if (y + i >= 0 && y + i < _M && x + j >= 0 && x + j < _N && boardAt(state, y + i, x + j) == BRD_MIN_DISC)
-			{
-				int p = y + 2 * i, q = x + 2 * j;
-				while (p >= 0 && p < _M && q >= 0 && q < _N)
-				{
-					// If we see an empty spot, this is not a valid direction
-					if (boardAt(state, p, q) == BRD_FREE) break;
-					if (boardAt(state, p, q) == BRD_MAX_DISC) return true;
-					p += i;
-					q += j;
-				}
-			}
-		}
-	}
-
-	return false;
+	return _kernels.isValidMove(&state.front(), y, x, BRD_MAX_DISC);
 }
 
 vector<gameMove> getMoves(const board &state, bool max)
 {
-	board brd = state;
+	TRACE_SCOPE(TRACE_MOVE_GEN);
 	vector<gameMove> moves(0);
-	vector<vector<bool>> visited = vector<vector<bool>>(_M, vector<bool>(_N, false));
-
-	// The legal moves for MIN are the same as the legal moves for MAX if all the discs were flipped
-	if (!max) brd = flipAll(state);
-
-	for (int i = 0; i < _M; i++)
-	{
-		for (int j = 0; j < _N; j++)
-		{
-			if (boardAt(brd, i, j) == BRD_FREE)
-			{
-				if (isValidMove(brd, i, j)) moves.push_back({ j, i });
-			}
-		}
-	}
-
+	_kernels.getMoves(&state.front(), max ? BRD_MAX_DISC : BRD_MIN_DISC, moves);
 	return moves;
 }
 
 void discCount(const board & state, int & maxD, int & minD)
 {
-	maxD = 0;
-	minD = 0;
-
-	for(int i = 0; i < _M; i++)
-	{
-		for(int j = 0; j < _N; j++)
-		{
-			if(boardAt(state, i, j) == BRD_MAX_DISC) maxD++;
-			else if(boardAt(state, i, j) == BRD_MIN_DISC) minD++;
-		}
-	}
+	_kernels.discCount(&state.front(), maxD, minD);
 }
 
 piece boardAt(const board &state, int y, int x)
@@ -167,6 +80,22 @@ void makeEmptyBoard(board &state)
 	state = board(_N * _M, BRD_FREE);
 }
 
+string moveString(const gameMove &mv)
+{
+	if (mv.x < 0) return "na";
+	stringstream ss;
+	ss << (char)(mv.x + 'a') << mv.y + 1;
+	return ss.str();
+}
+
+string lineString(const vector<gameMove> &line)
+{
+	stringstream ss;
+	for (size_t i = 0; i < line.size(); i++)
+		ss << (i > 0 ? " " : "") << (line[i].x < 0 ? "pass" : moveString(line[i]));
+	return ss.str();
+}
+
 string printBoard(const board & state, bool blackIsMax)
 {
 	stringstream ss;
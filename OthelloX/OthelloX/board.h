@@ -5,14 +5,10 @@
 
 #include "general.h"
 #include "parsing.h"
+#include "kernels.h"
 
 #include<fstream>
 
-// Flip MIN discs, moving i squares along the y-axis and j along the x-axis
-// If we reach the end or an empty square flip them back, if we see a MAX disc, leave them flipped
-// Return true if we see a MAX disc
-bool maybeFlipInDirection(board &state, int y, int x, signed char i, signed char j);
-
 // Generate the next board given the move
 board applyMove(const board &state, const gameMove &move, bool max);
 
@@ -47,6 +43,12 @@ void boardAssign(board &state, int index, piece value);
 // Set state to an empty board
 void makeEmptyBoard(board &state);
 
+// A move in board notation(ex: d3), "na" for no move
+string moveString(const gameMove &mv);
+
+// A line of play in board notation, with "pass" for passing moves
+string lineString(const vector<gameMove> &line);
+
 // Print the board on the terminal
 string printBoard(const board &state, bool blackIsMax);
 
@@ -0,0 +1,122 @@
+#pragma once
+#ifndef BOARDCORE_H
+#define BOARDCORE_H
+#endif // !BOARDCORE_H
+
+#include "stdafx.h"
+#include "general.h"
+
+/*
+Move generation kernels, templated on the board dimensions so that the compiler can fold
+the bounds into constants and unroll the direction loops.
+M, N - board height and width, 0 for sizes only known at runtime(_M, _N)
+Boards are passed as raw arrays of _M * _N squares and <me> is the disc of the player to move
+*/
+
+template<int M, int N>
+struct boardDims
+{
+	static inline int rows() { return M ? M : _M; }
+	static inline int cols() { return N ? N : _N; }
+};
+
+#define RAY_DIRECTIONS 8
+#define RAY_AXES 4
+
+// The two opposite directions of each axis - horizontal, vertical, diagonal and anti-diagonal
+static const int _axisDirections[RAY_AXES][2] = { { 3, 4 }, { 1, 6 }, { 0, 7 }, { 2, 5 } };
+
+/*
+For every square and direction, the squares from that square to the edge of the board, nearest first
+Built once per board size, so that the kernels below can walk a direction without any bounds checks
+*/
+struct rayTable
+{
+	vector<int> squares;	// All rays, one after the other
+	vector<int> start;		// Index of the first square of the ray for [square * RAY_DIRECTIONS + direction]
+	vector<int> length;		// Length of the ray for [square * RAY_DIRECTIONS + direction]
+};
+
+// The ray tables for this thread's board size, set by setBoardSize
+extern thread_local const rayTable *_rays;
+
+// Build the ray tables for a <rows> x <cols> board
+void initRayTables(rayTable &rays, int rows, int cols);
+
+// How many <-me> discs are there from <square> in direction <d>, before a <me> disc?
+// Returns 0 if the run is not closed by a <me> disc
+inline int flanked(const piece *state, int square, int d, piece me)
+{
+	int index = square * RAY_DIRECTIONS + d;
+	const int *ray = _rays->squares.data() + _rays->start[index];
+	int length = _rays->length[index];
+
+	int count = 0;
+	while (count < length && state[ray[count]] == -me)
+		count++;
+
+	if (count > 0 && count < length && state[ray[count]] == me)
+		return count;
+	return 0;
+}
+
+template<int M, int N>
+bool isValidMoveT(const piece *state, int y, int x, piece me)
+{
+	int square = y * boardDims<M, N>::cols() + x;
+	if (state[square] != BRD_FREE) return false;
+
+	for (int d = 0; d < RAY_DIRECTIONS; d++)
+	{
+		if (flanked(state, square, d, me) > 0) return true;
+	}
+
+	return false;
+}
+
+template<int M, int N>
+void getMovesT(const piece *state, piece me, vector<gameMove> &moves)
+{
+	const int rows = boardDims<M, N>::rows();
+	const int cols = boardDims<M, N>::cols();
+
+	for (int y = 0; y < rows; y++)
+	{
+		for (int x = 0; x < cols; x++)
+		{
+			if (state[y * cols + x] == BRD_FREE && isValidMoveT<M, N>(state, y, x, me))
+				moves.push_back({ x, y });
+		}
+	}
+}
+
+// Put a <me> disc on <y, x> and flip the flanked discs - the move must be valid
+template<int M, int N>
+void applyMoveT(piece *state, int y, int x, piece me)
+{
+	int square = y * boardDims<M, N>::cols() + x;
+
+	state[square] = me;
+	for (int d = 0; d < RAY_DIRECTIONS; d++)
+	{
+		// Only write once we know the discs have to be flipped
+		int count = flanked(state, square, d, me);
+		const int *ray = _rays->squares.data() + _rays->start[square * RAY_DIRECTIONS + d];
+		for (int k = 0; k < count; k++)
+			state[ray[k]] = me;
+	}
+}
+
+template<int M, int N>
+void discCountT(const piece *state, int &maxD, int &minD)
+{
+	const int squares = boardDims<M, N>::rows() * boardDims<M, N>::cols();
+
+	maxD = 0;
+	minD = 0;
+	for (int i = 0; i < squares; i++)
+	{
+		if (state[i] == BRD_MAX_DISC) maxD++;
+		else if (state[i] == BRD_MIN_DISC) minD++;
+	}
+}
@@ -0,0 +1,82 @@
+#include "stdafx.h"
+#include "context.h"
+#include "evaluate.h"
+#include "kernels.h"
+
+thread_local searchContext _searchContext;
+
+void initContext(searchContext &ctx, const evalParams &params, int rows, int cols)
+{
+	ctx.params = params;
+	ctx.rows = rows;
+	ctx.cols = cols;
+	ctx.deadline = deadlineAfter(timeNow(), moveTimeBudget(params.timeout));
+	ctx.table = processTable();
+
+	useContextBoard(ctx);
+	ctx.squareWeights = board(rows * cols);
+	fillWeightsMatrix(ctx.squareWeights, params);
+}
+
+void forkContext(searchContext &child, searchContext &parent)
+{
+	child.params = parent.params;
+	child.rows = parent.rows;
+	child.cols = parent.cols;
+	child.squareWeights = parent.squareWeights;
+	child.deadline = parent.deadline;
+	child.pollInterval = parent.pollInterval;
+	child.pollCountdown = parent.pollInterval;
+	child.lastPoll = timeNow();
+	child.budget = parent.budget;
+	child.table = parent.table;
+}
+
+searchContext &loadGlobalContext()
+{
+	searchContext &ctx = _searchContext;
+	ctx.params = _parameters;
+	ctx.rows = _M;
+	ctx.cols = _N;
+	ctx.squareWeights = _squareWeights;
+	ctx.deadline = searchDeadline();
+	ctx.writeReports = true;
+	ctx.table = processTable();
+	ctx.sharedTable = sharedTable();
+	return ctx;
+}
+
+void useContextBoard(const searchContext &ctx)
+{
+	if (_M != ctx.rows || _N != ctx.cols)
+		setBoardSize(ctx.rows, ctx.cols);
+}
+
+void startSearch(searchContext &ctx, int maxBoards)
+{
+	ctx.stats = searchStats();
+	ctx.budget->used = 0;
+	ctx.budget->limit = maxBoards;
+	ctx.budget->stopped = false;
+	ctx.pollCountdown = ctx.pollInterval; // Kept from the last search, the rate hardly changes
+	ctx.lastPoll = timeNow();
+}
+
+void flushBoards(searchContext &ctx)
+{
+	ctx.budget->used.fetch_add(ctx.stats.unflushedBoards, memory_order_relaxed);
+	ctx.stats.unflushedBoards = 0;
+}
+
+void mergeSearchStats(searchStats &into, const searchStats &from)
+{
+	into.boardsEvaluated += from.boardsEvaluated;
+	into.maxDepthReached = max(into.maxDepthReached, from.maxDepthReached);
+	into.entireSpaceCovered = into.entireSpaceCovered && from.entireSpaceCovered;
+	into.nodesPruned += from.nodesPruned;
+	into.estMaxDepthPruned += from.estMaxDepthPruned;
+	into.remoteProbes += from.remoteProbes;
+	into.remoteHits += from.remoteHits;
+	into.remoteStores += from.remoteStores;
+	into.remoteProbeNs += from.remoteProbeNs;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#ifndef CONTEXT_H
+#define CONTEXT_H
+#endif // !CONTEXT_H
+
+#include "stdafx.h"
+#include "general.h"
+#include "timing.h"
+#include "hashing.h"
+
+#define PV_MAX_PLY 64
+#define BUDGET_FLUSH_BATCH 256 // How many boards a thread evaluates before adding them to the shared count
+// How often a searching thread checks the clock and for stop messages - counted in nodes, at the rate measured since the last check
+#define STOP_POLL_SECONDS 0.0005	// Aimed for time between checks, the deadline is kept to about this
+#define STOP_POLL_START_NODES 256	// Nodes before the first check of a thread, while its rate is not known
+#define STOP_POLL_MIN_NODES 16
+#define STOP_POLL_MAX_NODES 65536
+#define STOP_POLL_US 1000 // How often a thread waiting for its helpers checks for stop messages
+
+// Counters for a search, kept by each searching thread and merged at the end
+struct searchStats
+{
+	int boardsEvaluated = 0;			// How many boards have we evaluated in total
+	int maxDepthReached = 0;			// The maximum depth we reached
+	bool entireSpaceCovered = true;		// Have we looked through the entire search space
+	int nodesPruned = 0;				// How many nodes we pruned
+	int estMaxDepthPruned = 0;			// Estimate of the nodes at maxDepth that were pruned
+	int unflushedBoards = 0;			// Boards evaluated, but not yet counted against the shared board budget
+	// Use of the table shared by the slaves
+	int remoteProbes = 0;
+	int remoteHits = 0;
+	int remoteStores = 0;
+	long long remoteProbeNs = 0;		// Total time spent waiting for probes
+};
+
+/*
+How many boards a search may evaluate, and whether it has to stop, shared by all of its threads
+Each thread counts its boards in its own stats and adds them to <used> in batches
+*/
+struct boardBudget
+{
+	atomic<long long> used;
+	long long limit;
+	atomic<bool> stopped;	// Out of time, or told to stop - set by whichever thread finds out first
+};
+
+/*
+Triangular table of principal variations
+Row <ply> holds the best line found so far from the node being searched at that ply - when a move improves on
+the best one, the row becomes that move followed by the row of the next ply. Only full searches write to it, not probes.
+*/
+struct pvTable
+{
+	gameMove moves[PV_MAX_PLY][PV_MAX_PLY];
+	int length[PV_MAX_PLY];
+};
+
+struct valueMove
+{
+	int value;
+	gameMove move;
+	bool isExact = true; // False if <value> is only an upper bound
+	vector<gameMove> pv; // The expected line of play, starting with <move>(empty if <value> is a bound)
+};
+
+/*
+Everything a search reads and writes, so that a process can run several independent searches at once,
+on different threads and board sizes. A context is used by one thread at a time - threads that work on
+the same search each get their own context and share the budget.
+*/
+struct searchContext
+{
+	evalParams params;					// How to search and evaluate
+	int rows;							// Board size - the thread's board kernels are switched to it when a search starts
+	int cols;
+	board squareWeights;				// Weights for static evaluation
+	timePoint deadline;					// The search stops once this passes
+	bool writeReports = false;			// Print the scored root moves at the end of a search
+	searchStats stats;					// Counters of the current search
+	pvTable pv;							// Principal variations of the current search
+	vector<valueMove> rootMoves;		// Scored root moves of the last search, best first
+	boardBudget ownBudget;				// Budget of a search that doesn't share it with other contexts
+	boardBudget *budget = &ownBudget;	// The budget boards are counted against
+	transpositionTable *table = nullptr;	// Shared by all contexts of the process, null if there is none
+	distributedTable *sharedTable = nullptr;	// Shared by the slaves, null if there is none. Only for the thread that called MPI_Init.
+	bool (*pollMessages)() = nullptr;	// Checks for a message stopping the search, null if there are none. Only for the thread that called MPI_Init.
+	int pollCountdown = STOP_POLL_START_NODES;	// Nodes left until the clock and the messages are checked again
+	int pollInterval = STOP_POLL_START_NODES;	// What the countdown started from
+	timePoint lastPoll;					// When the countdown started
+};
+
+/*
+The context used by the functions that take no context - the search of the main program, the
+slaves and the benchmarks. Loaded from the globals(_parameters, _M, _N, _squareWeights, the search deadline) at the
+start of each of those searches.
+*/
+extern thread_local searchContext _searchContext;
+
+// Set up <ctx> for searches on a <rows> x <cols> board, with the timeout counted from now, using the process' table
+void initContext(searchContext &ctx, const evalParams &params, int rows, int cols);
+
+// Set up <child> to help with the search of <parent> on another thread - same settings, deadline and node rate, shared budget and table
+void forkContext(searchContext &child, searchContext &parent);
+
+// Copy the globals into this thread's _searchContext, which uses the process' tables
+searchContext &loadGlobalContext();
+
+// Switch this thread's board size to the context's, if needed
+void useContextBoard(const searchContext &ctx);
+
+// Reset the stats, the budget and the stop flag of <ctx> for a new search of up to <maxBoards> boards
+void startSearch(searchContext &ctx, int maxBoards);
+
+// Add the boards <ctx> has not counted yet to its budget
+void flushBoards(searchContext &ctx);
+
+// Add the counters of <from> to <into>
+void mergeSearchStats(searchStats &into, const searchStats &from);
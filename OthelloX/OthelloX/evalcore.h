@@ -0,0 +1,102 @@
+#pragma once
+#ifndef EVALCORE_H
+#define EVALCORE_H
+#endif // !EVALCORE_H
+
+#include "stdafx.h"
+#include "general.h"
+#include "boardcore.h"
+
+/*
+Evaluation kernels, templated on the board dimensions like the ones in boardcore.h
+*/
+
+/*
+Count the "stable" discs of both players - the discs that can never be flipped back
+A disc is stable if along each of the four axes its line is full, or it is next to the edge of the
+board or to a stable disc of the same colour, or it is between two stable discs of the other colour.
+Starting with no stable discs, mark the ones that satisfy this until nothing changes. The bitboard
+kernels do the same thing on whole boards at once.
+This is a lower bound - a disc can also be safe through patterns of empty squares and discs further
+along its lines, which these rules don't look at. Every disc counted is really stable.
+*/
+template<int M, int N>
+void stableDiscsT(const piece *state, int &maxStable, int &minStable)
+{
+	const int squares = boardDims<M, N>::rows() * boardDims<M, N>::cols();
+
+	// Per square, a bit for each axis along which the disc can't be flanked whatever its neighbours do
+	vector<uint8_t> safe(squares, 0);
+	vector<uint8_t> stable(squares, 0);
+	for (int s = 0; s < squares; s++)
+	{
+		if (state[s] == BRD_FREE) continue;
+		for (int a = 0; a < RAY_AXES; a++)
+		{
+			bool full = true;
+			bool edge = false;
+			for (int k = 0; k < 2; k++)
+			{
+				int index = s * RAY_DIRECTIONS + _axisDirections[a][k];
+				const int *ray = _rays->squares.data() + _rays->start[index];
+				if (_rays->length[index] == 0) edge = true;
+				for (int r = 0; r < _rays->length[index] && full; r++)
+					full = state[ray[r]] != BRD_FREE;
+			}
+			if (full || edge) safe[s] |= 1 << a;
+		}
+	}
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (int s = 0; s < squares; s++)
+		{
+			if (state[s] == BRD_FREE || stable[s]) continue;
+
+			int axes = safe[s];
+			for (int a = 0; a < RAY_AXES; a++)
+			{
+				int stableOpponents = 0;
+				for (int k = 0; k < 2 && !(axes & (1 << a)); k++)
+				{
+					int index = s * RAY_DIRECTIONS + _axisDirections[a][k];
+					if (_rays->length[index] == 0) continue;
+					int next = _rays->squares[_rays->start[index]];
+					if (stable[next] && state[next] == state[s]) axes |= 1 << a;
+					if (stable[next] && state[next] == -state[s]) stableOpponents++;
+				}
+				// Between two discs that stay the opponent's, the disc is never part of a run that can be flanked
+				if (stableOpponents == 2) axes |= 1 << a;
+			}
+
+			if (axes == (1 << RAY_AXES) - 1)
+			{
+				stable[s] = 1;
+				changed = true;
+			}
+		}
+	}
+
+	maxStable = 0;
+	minStable = 0;
+	for (int s = 0; s < squares; s++)
+	{
+		if (!stable[s]) continue;
+		if (state[s] == BRD_MAX_DISC) maxStable++;
+		else minStable++;
+	}
+}
+
+// Sum of the discs on the board, weighted by <weights>
+template<int M, int N>
+int staticScoreT(const piece *state, const piece *weights)
+{
+	const int squares = boardDims<M, N>::rows() * boardDims<M, N>::cols();
+
+	int score = 0;
+	for (int i = 0; i < squares; i++)
+		score += state[i] * weights[i];
+	return score;
+}
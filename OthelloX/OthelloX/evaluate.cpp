@@ -1,153 +1,88 @@
 #include "stdafx.h"
 #include "evaluate.h"
 #include "processes.h"
+#include "trace.h"
 
 board _squareWeights;
 
-// Returns the number of "stable" MAX discs
-// We call "stable" discs that cannot be flipped back
-int stableDiscCount(const board &state)
+void dynamicFeatures(const board &state, int maxMoves, int minMoves, float *features)
 {
-	int n = _M, m = _N;
-	vector<vector<bool>> visited = vector<vector<bool>>(n, vector<bool>(m, false));
-	int result = 0;
-
-	// Check corners. If there is a MAX disc in a corner, go along the sides and count the number
-	// of contiguous MAX discs. Go to the next row. Count the number of contiguous MAX discs up to
-	// the count on the border row. Go to the next row. Count up to the number in the last row.
-	// Repeat until the count is 0 or we reach the number of contiguous discs on the border column.
-	for (int N = 1; N >= 0; N--) // 1 - we're at a North corner
-	{
-		for (int W = 1; W >= 0; W--) // 1 - we're at a West corner
-		{
-			// Corner indices
-			int i = n - n * N - (1 - N);
-			int j = m - m * W - (1 - W);
-			// Increments, +1 or -1, depending on the corner
-			int i_inc = -1 + 2 * N;
-			int j_inc = -1 + 2 * W;
-
-			if (boardAt(state, i, j) == BRD_MAX_DISC)
-			{
-				visited[i][j] = true;
-				result++;
-
-				// Count the discs on the border row
-				int borderRowCount = 0;
-				while (j < m && j >= 0 && boardAt(state, i, j) == BRD_MAX_DISC && !visited[i][j])
-				{
-					visited[i][j] = true;
-					borderRowCount++;
-					result++;
-					j += j_inc;
-				}
-				j = m - m * W - (1 - W); // Reset j to its initial value
-
-				// Count the discs on the border column
-				int borderColumnCount = 0;
-				while (i < n && i >= 0 && boardAt(state, i, j) == BRD_MAX_DISC && !visited[i][j])
-				{
-					visited[i][j] = true;
-					borderColumnCount++;
-					result++;
-					i += i_inc;
-				};
-				i = n - n * N - (1 - N); // Reset i to its original value
-
-				// Go to the next row. If we counted only the border element on the last row,
-				// we won't find any new stable discs from now on. Abort
-				int lastRowCount = borderRowCount;
-				while (i + i_inc < borderColumnCount && lastRowCount > 1)
-				{
-					i += i_inc;
-					// Set j to the column next to the border one
-					j = m - m * W - (1 - W) + j_inc;
-
-					// Count the disks on this row. Cannot be more than the last row count - 
-					// any discs beyoud that won't be stable
-					int thisRowCount = 1;
-					while (thisRowCount < lastRowCount && boardAt(state, i, j) == BRD_MAX_DISC && !visited[i][j])
-					{
-						visited[i][j] = true;
-						thisRowCount++;
-						result++;
-						j += j_inc;
-					}
-
-					lastRowCount = thisRowCount;
-				}
-			}
-		}
-	}
-
-	return result;
-}
-
-
-
-int evalBoardDynamic(const board &state, bool isFinal, int maxMoves, int minMoves)
-{
-	board flippedState = flipAll(state); // Used to calculate values for MIN
-
 	int maxDiscs, minDiscs;
 	discCount(state, maxDiscs, minDiscs); // Get the number of discs for each player
 	// Score based on the disc count
-	float parityScore = 100 * (maxDiscs - minDiscs) / ((float)(maxDiscs + minDiscs));
+	features[FEATURE_PARITY] = 100 * (maxDiscs - minDiscs) / ((float)(maxDiscs + minDiscs));
 
 	// Score based on the mobility(number of available moves) for each player
-	float mobilityScore = 0;
+	features[FEATURE_MOBILITY] = 0;
 	if (maxMoves + minMoves != 0)
-	{
-		mobilityScore = (maxMoves - minMoves) / ((float)(maxMoves + minMoves));
-	}
-	else // No more moves - this is a final state of the board
-	{
-		int result = maxDiscs - minDiscs;
-		// Intermediate scores are in the -100-100 range.
-		// We add 100 to the result to make sure final evaluations have more weight than
-		// the approximations we make when making a cutoff.
-		if (result > 0)
-			return 30000 + result;
-		else if (result < 0)
-			return -30000 + result;
-		else return 0;
-	}
+		features[FEATURE_MOBILITY] = (maxMoves - minMoves) / ((float)(maxMoves + minMoves));
 
-	int maxStableCount = stableDiscCount(state);
-	int minStableCount = stableDiscCount(flippedState);
+	int maxStableCount, minStableCount;
+	_kernels.stableDiscs(&state.front(), maxStableCount, minStableCount);
 	// Score based on the number of stable discs
-	float stabilityScore = 0;
+	features[FEATURE_STABILITY] = 0;
 	if (maxStableCount + minStableCount != 0)
-		stabilityScore = 100 * (maxStableCount - minStableCount) / ((float)(maxStableCount + minStableCount));
+		features[FEATURE_STABILITY] = 100 * (maxStableCount - minStableCount) / ((float)(maxStableCount + minStableCount));
+}
 
-	LOG_DEBUG("======== Evaluating board: \n" << printBoard(state, _parameters.black) << "Scores:"
-					    << "Parity: " << parityScore << endl << "Max stable count: " << maxStableCount << ", MIN stable count: "
-						<< minStableCount << endl << ", Stability: " << stabilityScore << "MAX moves: " << maxMoves 
-						<< ", MIN moves: " << minMoves << endl << ", Mobility: " << mobilityScore << endl
-						<< "Utility: " << _parameters.parityWeight * parityScore + _parameters.stabilityWeight + stabilityScore +
-						_parameters.mobilityWeight * mobilityScore << endl);
-	
+int finalScore(int discDifference)
+{
+	// Intermediate scores are in the -100-100 range.
+	// We add 100 to the result to make sure final evaluations have more weight than
+	// the approximations we make when making a cutoff.
+	if (discDifference > 0)
+		return FINAL_SCORE_OFFSET + discDifference;
+	else if (discDifference < 0)
+		return -FINAL_SCORE_OFFSET + discDifference;
+	else return 0;
+}
 
-	return _parameters.parityWeight * parityScore + _parameters.stabilityWeight + stabilityScore + _parameters.mobilityWeight * mobilityScore;
+int stabilityBound(const searchContext &ctx, const board &state, bool maxTurn)
+{
+	// Static scores are not tied to the final disc count
+	if (ctx.params.useStaticEvaluation) return INT_MAX;
+
+	// At best, every square that is not a stable opponent disc ends up ours
+	int maxStable, minStable;
+	_kernels.stableDiscs(&state.front(), maxStable, minStable);
+	int opponentStable = maxTurn ? minStable : maxStable;
+	return finalScore(ctx.rows * ctx.cols - 2 * opponentStable);
 }
 
-int evalBoardStatic(const board &state, bool isFinal)
+int evalBoardDynamic(const searchContext &ctx, const board &state, bool isFinal, int maxMoves, int minMoves)
 {
-	int score = 0;
-	for(int i = 0; i < _M; i++)
+	// No more moves - this is a final state of the board
+	if (maxMoves + minMoves == 0)
 	{
-		for(int j = 0; j < _N; j++)
-			score += boardAt(state, i, j) * boardAt(_squareWeights, i, j);
+		int maxDiscs, minDiscs;
+		discCount(state, maxDiscs, minDiscs);
+		return finalScore(maxDiscs - minDiscs);
 	}
-	return score;
+
+	float features[DYNAMIC_FEATURE_COUNT];
+	dynamicFeatures(state, maxMoves, minMoves, features);
+	float utility = ctx.params.parityWeight * features[FEATURE_PARITY] + ctx.params.stabilityWeight * features[FEATURE_STABILITY] +
+					ctx.params.mobilityWeight * features[FEATURE_MOBILITY];
+
+	LOG_DEBUG("======== Evaluating board: \n" << printBoard(state, ctx.params.black) << "Scores:"
+					    << "Parity: " << features[FEATURE_PARITY] << endl << ", Stability: " << features[FEATURE_STABILITY]
+						<< "MAX moves: " << maxMoves << ", MIN moves: " << minMoves << endl << ", Mobility: " << features[FEATURE_MOBILITY] << endl
+						<< "Utility: " << utility << endl);
+
+	return utility;
+}
+
+int evalBoardStatic(const searchContext &ctx, const board &state, bool isFinal)
+{
+	return _kernels.staticScore(&state.front(), &ctx.squareWeights.front());
 }
 
-int evalBoardStatic(const board &state, int masterId, int slaveCount, bool isFinal)
+int evalBoardStatic(const searchContext &ctx, const board &state, int masterId, int slaveCount, bool isFinal)
 {
 	int score = 0;
 	if(slaveCount < 2)
 	{
-		return evalBoardStatic(state, isFinal);
+		return evalBoardStatic(ctx, state, isFinal);
 	}
 	else // We have more than one slave
 	{
@@ -176,7 +111,7 @@ int evalBoardStatic(const board &state, int masterId, int slaveCount, bool isFin
 			int masterSubScore = 0;
 			for(int i = _displacements[MASTER_ID]; i < _displacements[MASTER_ID] + _sendCounts[MASTER_ID]; i++)
 			{
-				masterSubScore += state[i] * _squareWeights[i];
+				masterSubScore += state[i] * ctx.squareWeights[i];
 			}
 
 			// // Gather results
@@ -204,51 +139,78 @@ int evalBoardStatic(const board &state, int masterId, int slaveCount, bool isFin
 	return score;
 }
 
-void fillWeightsMatrix(board &matrix)
+int squareClass(int i, int j)
+{
+	// Corners
+	if((i == 0 && j == 0) || (i == 0 && j == _N - 1) || (i == _M - 1 && j == 0) || (i == _M - 1 && j == _N - 1))
+		return SQUARE_CORNER;
+	// C-squares
+	else if((i == 0 && j == 1) || (i == 0 && j == _N - 2) || (i == 1 && j == 0) || (i == 1 && j == _N - 1) || 
+			(i == _M - 2 && j == 0) || (i == _M - 2 && j == _N - 1) || (i == _M - 1 && j == 1) || (i == _M - 1 && j == _N - 2))
+		return SQUARE_C;
+	// X-squares
+	else if((i == 1 && j == 1) || (i == 1 && j == _N - 2) || (i == _M - 2 && j == 1) || (i == _M - 2 && j == _N - 2))
+		return SQUARE_X;
+	// Edges
+	else if((i == 0) || (i == _M - 1) || (j == 0) || (j == _N - 1))
+		return SQUARE_EDGE;
+	// Inner squares
+	else if((i > 1 && i < _M - 2 && j > 1 && j < _N - 2))
+		return SQUARE_INNER;
+	else
+		return SQUARE_NONE;
+}
+
+void staticFeatures(const board &state, float *features)
+{
+	for(int c = 0; c < STATIC_FEATURE_COUNT; c++)
+		features[c] = 0;
+
+	for(int i = 0; i < _M; i++)
+	{
+		for(int j = 0; j < _N; j++)
+		{
+			int c = squareClass(i, j);
+			if(c != SQUARE_NONE)
+				features[c] += boardAt(state, i, j);
+		}
+	}
+}
+
+void fillWeightsMatrix(board &matrix, const evalParams &params)
 {
 	for(int i = 0; i < _M; i++)
 	{
 		for(int j = 0; j < _N; j++)
 		{
-			// Corners
-			if((i == 0 && j == 0) || (i == 0 && j == _N - 1) || (i == _M - 1 && j == 0) || (i == _M - 1 && j == _N - 1))
-				boardAssign(matrix, i, j, _parameters.cornerWeight);
-			// C-squares
-			else if((i == 0 && j == 1) || (i == 0 && j == _N - 2) || (i == 1 && j == 0) || (i == 1 && j == _N - 1) || 
-					(i == _M - 2 && j == 0) || (i == _M - 2 && j == _N - 1) || (i == _M - 1 && j == 1) || (i == _M - 1 && j == _N - 2))
-				boardAssign(matrix, i, j, _parameters.cSquareWeight);
-			// X-squares
-			else if((i == 1 && j == 1) || (i == 1 && j == _N - 2) || (i == _M - 2 && j == 1) || (i == _M - 2 && j == _N - 2))
-				boardAssign(matrix, i, j, _parameters.xSquareWieght);
-			// Edges
-			else if((i == 0) || (i == _M - 1) || (j == 0) || (j == _N - 1))
-				boardAssign(matrix, i, j, _parameters.edgeSquareWeight);
-			// Inner squares
-			else if((i > 1 && i < _M - 2 && j > 1 && j < _N - 2))
-				boardAssign(matrix, i, j , _parameters.innerSquareWeight);
-			else
-				boardAssign(matrix, i, j, 0);
+			switch(squareClass(i, j))
+			{
+				case SQUARE_CORNER: boardAssign(matrix, i, j, params.cornerWeight); break;
+				case SQUARE_C: boardAssign(matrix, i, j, params.cSquareWeight); break;
+				case SQUARE_X: boardAssign(matrix, i, j, params.xSquareWieght); break;
+				case SQUARE_EDGE: boardAssign(matrix, i, j, params.edgeSquareWeight); break;
+				case SQUARE_INNER: boardAssign(matrix, i, j , params.innerSquareWeight); break;
+				default: boardAssign(matrix, i, j, 0);
+			}
 		}
 	}
 }
 
-int evalBoard(const board &state, bool isFinal, int maxMoves, int minMoves)
+int evalBoard(const searchContext &ctx, const board &state, bool isFinal, int maxMoves, int minMoves)
 {
+	TRACE_SCOPE(TRACE_EVAL);
 	int result;
-	timePoint before = timeNow();
-	timePoint after;
-	if(_parameters.useStaticEvaluation)
+	if(ctx.params.useStaticEvaluation)
 	{
-		if(_parameters.parallelSearch)
-			result = evalBoardStatic(state, isFinal);
+		// Boards are only split between the processes for the main program's serial search
+		if(ctx.params.parallelSearch)
+			result = evalBoardStatic(ctx, state, isFinal);
 		else
-			result = evalBoardStatic(state, MASTER_ID, _slaveCount, isFinal);
+			result = evalBoardStatic(ctx, state, MASTER_ID, _slaveCount, isFinal);
 	}
 	else
 	{
-		result = evalBoardDynamic(state, isFinal, maxMoves, minMoves);
+		result = evalBoardDynamic(ctx, state, isFinal, maxMoves, minMoves);
 	}
-	after = timeNow();
-	_totalEvaluationTime += nsBetween(before, after);
 	return result;
 }
\ No newline at end of file
@@ -6,10 +6,54 @@
 #include "stdafx.h"
 #include "general.h"
 #include "board.h"
+#include "context.h"
 
-// Evaluates a board in an intermediate state
+// Indices of the features used by the dynamic evaluator
+#define FEATURE_PARITY 0
+#define FEATURE_MOBILITY 1
+#define FEATURE_STABILITY 2
+#define DYNAMIC_FEATURE_COUNT 3
+
+// Square classes used by the static evaluator - also the indices of the static features
+#define SQUARE_CORNER 0
+#define SQUARE_X 1
+#define SQUARE_C 2
+#define SQUARE_EDGE 3
+#define SQUARE_INNER 4
+#define STATIC_FEATURE_COUNT 5
+#define SQUARE_NONE STATIC_FEATURE_COUNT // Squares that are not weighted
+
+// Final boards score at least this much(in absolute value) more than any intermediate one
+#define FINAL_SCORE_OFFSET 30000
+
+// Evaluates a board in an intermediate state, with the evaluator and weights of <ctx>
 // max - it is MAX's turn?
-int evalBoard(const board &state, bool isFinal, int maxMoves, int minMoves);
+int evalBoard(const searchContext &ctx, const board &state, bool isFinal, int maxMoves, int minMoves);
+
+// The score of a final board, given the disc difference for the player it is scored for
+int finalScore(int discDifference);
+
+/*
+The best score the player to move can still reach, given the opponent's stable discs
+In the same scale as evalBoard, for the player to move. INT_MAX if there is no such bound for the evaluator in use
+*/
+int stabilityBound(const searchContext &ctx, const board &state, bool maxTurn);
+
+/*
+Compute the unweighted features of the dynamic evaluator for a non-final board
+features - an array of DYNAMIC_FEATURE_COUNT values, indexed by FEATURE_*
+*/
+void dynamicFeatures(const board &state, int maxMoves, int minMoves, float *features);
+
+/*
+Compute the features of the static evaluator - the difference between the number of
+MAX and MIN discs on each class of squares
+features - an array of STATIC_FEATURE_COUNT values, indexed by SQUARE_*
+*/
+void staticFeatures(const board &state, float *features);
+
+// Get the class(SQUARE_*) of the square at <i, j>
+int squareClass(int i, int j);
 
-// Generate coefficient matrix
-void fillWeightsMatrix(board &matrix);
\ No newline at end of file
+// Generate coefficient matrix from the static evaluation weights in <params>
+void fillWeightsMatrix(board &matrix, const evalParams &params);
\ No newline at end of file
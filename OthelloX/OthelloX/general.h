@@ -22,6 +22,30 @@
 #define DEFAULT_STABILITY_WEIGHT 40
 #define DEFAULT_MOBILITY_WEIGHT 30
 
+// Forward pruning
+#define PROBCUT_MAX_DEPTH 32			// Checks can be set for remaining depths below this
+#define PROBCUT_MAX_CHECKS 3			// Checks per depth - more than one gives multi-ProbCut
+#define DEFAULT_PROBCUT_THRESHOLD 1.5f	// How many standard deviations away from the bound must a prediction be
+
+#define DEFAULT_SHARED_HASH_DEPTH 6
+
+// How the search threads of a node are placed on its cores(see affinity.h)
+enum placementPolicy
+{
+	PLACE_NONE,
+	PLACE_COMPACT,
+	PLACE_SCATTER,
+	PLACE_NUMA
+};
+
+// What kind of pages the large tables are in(see hugepages.h)
+enum hugePageMode
+{
+	HUGE_PAGES_OFF,
+	HUGE_PAGES_TRANSPARENT,
+	HUGE_PAGES_EXPLICIT
+};
+
 // Represents the game board
 // 0 - free square
 // 1 -	square, occupied by MAX
@@ -30,6 +54,18 @@ typedef int8_t piece;
 // typedef vector<piece> row;
 typedef vector<piece> board;
 
+/*
+A ProbCut check - predicts the result of a deep search from a shallow one
+deep ~= a * shallow + b, with a standard deviation of sigma, as measured on sample positions
+*/
+struct probCutCheck
+{
+	short shallowDepth;
+	float a;
+	float b;
+	float sigma;
+};
+
 // Holds the evaluation parameters as parsed from params file
 struct evalParams
 {
@@ -52,24 +88,38 @@ struct evalParams
 	piece cSquareWeight = - 4;
 	piece edgeSquareWeight = 2;
 	piece innerSquareWeight = 1;
+	// How often should the master report on the slaves during a parallel search, in seconds(0 - only at the end)
+	float metricsInterval = 0;
+	// How many root moves get an exact score in a serial search, the rest are only shown not to be better(0 - score all of them)
+	int multiPV = 0;
+	// How many threads split the root moves of a serial search between them(0 - one per core)
+	int threads = 1;
+	// Size of the transposition table shared by the threads of a process, in MB(0 - no table)
+	int hashSize = 0;
+	// Size of each slave's part of the transposition table shared by the slaves of a parallel search, in MB(0 - no table)
+	// Only used when the slaves search with one thread each - their pool threads can't make MPI calls
+	int sharedHashSize = 0;
+	// Only nodes with at least this much depth left are looked up in and stored to the shared table
+	int sharedHashDepth = DEFAULT_SHARED_HASH_DEPTH;
+	// The largest share of the estimated work a job may have before it is split further(0 - one over the minimum number of jobs)
+	float maxJobShare = 0;
+	// Where the search threads run - left to the OS by default
+	placementPolicy placement = PLACE_NONE;
+	// What kind of pages the transposition tables are in - normal ones by default
+	hugePageMode hugePages = HUGE_PAGES_OFF;
+	// Forward pruning
+	bool useStabilityCutoff = false; // Cut nodes whose best score given the stable discs cannot beat alpha
+	float probCutThreshold = DEFAULT_PROBCUT_THRESHOLD;
+	int probCutCount[PROBCUT_MAX_DEPTH] = {}; // How many checks for each remaining depth, none - no ProbCut at that depth
+	probCutCheck probCut[PROBCUT_MAX_DEPTH][PROBCUT_MAX_CHECKS]; // Checks for each remaining depth, shallowest first
 };
 
 extern evalParams _parameters;
 
-// How many boards have we evaluated in total
-extern int _boardsEvaluated;
-// The maximum depth we reached
-extern int _maxDepthReached;
-// Have we looked through the entire search space
-extern bool _entireSpaceCovered;
-// How many nodes we pruned
-extern int _nodesPruned;
-// Estimate of the nodes at maxDepth that were pruned
-extern int _estMaxDepthPruned;
-// Board height
-extern int _M;
+// Board height, for the board size this thread is working on(see setBoardSize)
+extern thread_local int _M;
 // Board width
-extern int _N;
+extern thread_local int _N;
 // Weights for static evaluation
 extern board _squareWeights;
 // For parallel evaluation:
@@ -82,6 +132,11 @@ extern int *_subScores;
 // For parallel processes
 extern int _slaveCount;
 extern int _currentProcId;
+// The processes on the same node as this one - with one process per node, the search threads share its memory
+extern MPI_Comm _nodeComm;
+extern int _ranksOnNode;
+// The thread support MPI provides - searches only use threads if the main thread may call MPI while they run
+extern int _mpiThreadSupport;
 // For timing
 extern long long _totalEvaluationTime;
 extern long long _parallelEvalCommTime;
@@ -94,3 +149,6 @@ struct gameMove
 	int x;
 	int y;
 };
+
+// Stands for a player passing in a line of play
+#define PASS_MOVE gameMove{ -1, -1 }
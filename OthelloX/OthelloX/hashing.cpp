@@ -1,64 +1,266 @@
 #include "stdafx.h"
 #include "hashing.h"
+#include "board.h"
+#include "trace.h"
 
-// Store the random values   in a 3 x (N x M) 2d array - a different bitstring for every possible state(MIN, MAX, empty) of each square
-vector<vector<unsigned long long>> _randomNumbers;
+transpositionTable _transpositionTable;
+distributedTable _distributedTable;
 
-// Only store the hashes, not the whole board - collisions are extremely rare and do not affect performance greatly
-unordered_map<unsigned long long, hashEntry> _map;
-
-unsigned long long getHash(const board &state)
+// Random values for every possible state(MIN, empty, MAX) of each square, 3 x (M x N), and the side to move
+struct zobristKeys
 {
-	unsigned long long hash = 0ULL;
+	vector<unsigned long long> squares;
+	unsigned long long maxTurn;
+};
+
+// Keys for each board size, built on first use
+static map<pair<int, int>, unique_ptr<zobristKeys>> _zobristKeys;
+static mutex _zobristKeysLock;
+
+// The keys for the board size this thread last hashed
+static thread_local const zobristKeys *_keys = nullptr;
+static thread_local int _keysRows = 0;
+static thread_local int _keysCols = 0;
 
-	// Go over each square and XOR the has with the corresponding random number
-	for (int i = 0; i < _M; i++)
+// Initialise the random bitstrings for a <rows> x <cols> board
+static const zobristKeys *keysFor(int rows, int cols)
+{
+	lock_guard<mutex> guard(_zobristKeysLock);
+	unique_ptr<zobristKeys> &keys = _zobristKeys[make_pair(rows, cols)];
+	if (!keys)
 	{
-		for (int j = 0; j < _N; j++)
+		// A fixed seed per size, so that every process hashes a board the same way
+		mt19937_64 mtEngine(rows * 1000 + cols);
+		keys.reset(new zobristKeys());
+		keys->squares = vector<unsigned long long>(3 * rows * cols);
+		for (auto it = keys->squares.begin(); it != keys->squares.end(); it++)
 		{
-			// Values on the board got from -1 to 1, so increment them by 1 to get
-			// the random table row index
-			hash ^= _randomNumbers[boardAt(state, i, j) + 1][i * _M + j];
+			*(it) = mtEngine();
 		}
+		keys->maxTurn = mtEngine();
+	}
+	return keys.get();
+}
+
+unsigned long long hashBoard(const board &state, bool maxTurn)
+{
+	TRACE_SCOPE(TRACE_HASH);
+	if (_keysRows != _M || _keysCols != _N)
+	{
+		_keys = keysFor(_M, _N);
+		_keysRows = _M;
+		_keysCols = _N;
 	}
-	
+
+	unsigned long long hash = maxTurn ? _keys->maxTurn : 0ULL;
+	int squares = _M * _N;
+
+	// Go over each square and XOR the hash with the corresponding random number
+	for (int i = 0; i < squares; i++)
+	{
+		// Values on the board go from -1 to 1, so increment them by 1 to get the random table row
+		hash ^= _keys->squares[(boardAt(state, i) + 1) * squares + i];
+	}
+
 	return hash;
 }
 
-void initZorbistTable(int N, int M)
+// Pack an entry into 64 bits - 16 for the score, 16 for the depth, 8 for the bound and 8 for each coordinate of the move
+static unsigned long long packEntry(const hashEntry &info)
 {
-	// Define a uniform integer distribution to generate random bitstrings of length 64 using a Mersenne twister engine
-	random_device rd;
-	mt19937_64 mtEngine(rd());
-	uniform_int_distribution<unsigned long long> dist(llround(pow(2, 63)), llround(pow(2, 64)));
+	return (unsigned long long)(unsigned short)info.score
+		| (unsigned long long)(unsigned short)info.depth << 16
+		| (unsigned long long)(unsigned char)info.bound << 32
+		| (unsigned long long)(unsigned char)info.bestMove.x << 40
+		| (unsigned long long)(unsigned char)info.bestMove.y << 48;
+}
 
-	_randomNumbers = vector<vector<unsigned long long>>(3, vector<unsigned long long>(M * N));
+static hashEntry unpackEntry(unsigned long long data)
+{
+	hashEntry info;
+	info.score = (short)(data & 0xFFFF);
+	info.depth = (short)(data >> 16 & 0xFFFF);
+	info.bound = (char)(data >> 32 & 0xFF);
+	info.bestMove.x = (signed char)(data >> 40 & 0xFF);
+	info.bestMove.y = (signed char)(data >> 48 & 0xFF);
+	return info;
+}
 
-	for (auto it = _randomNumbers.begin(); it != _randomNumbers.end(); it++)
+void initTranspositionTable(int megabytes, hugePageMode pages)
+{
+	size_t slotCount = 0;
+	if (megabytes > 0)
 	{
-		for (auto it_i = it->begin(); it_i != it->end(); it_i++)
-		{
-			*(it_i) = dist(mtEngine);
-		}
+		// The largest power of 2 that fits
+		size_t maxSlots = (size_t)megabytes * 1024 * 1024 / sizeof(hashSlot);
+		slotCount = 1;
+		while (slotCount * 2 <= maxSlots) slotCount *= 2;
+	}
+
+	transpositionTable &table = _transpositionTable;
+	table.slots = nullptr;
+	table.slotCount = 0;
+	if (!allocateTableMemory(table.memory, slotCount * sizeof(hashSlot), pages) || slotCount == 0)
+		return;
+
+	// Zeroed slots are empty. Still written here, so that the pages are on this thread's NUMA node.
+	table.slots = (hashSlot *)table.memory.address;
+	table.slotCount = slotCount;
+	for (size_t i = 0; i < slotCount; i++)
+	{
+		new (&table.slots[i]) hashSlot;
+		table.slots[i].check.store(0, memory_order_relaxed);
+		table.slots[i].data.store(0, memory_order_relaxed);
 	}
-	
 }
 
-void hashState(const board & state, hashEntry info)
+transpositionTable *processTable()
 {
-	_map[getHash(state)] = info;
+	return _transpositionTable.slotCount > 0 ? &_transpositionTable : nullptr;
 }
 
-bool getInfoForState(const board & state, hashEntry & info)
+void clearTable(transpositionTable &table)
 {
-	unsigned long long hash = getHash(state);
-	auto res = _map.find(hash);
+	for (size_t i = 0; i < table.slotCount; i++)
+	{
+		table.slots[i].check.store(0, memory_order_relaxed);
+		table.slots[i].data.store(0, memory_order_relaxed);
+	}
+}
+
+bool probeTable(const transpositionTable &table, unsigned long long key, hashEntry &info)
+{
+	TRACE_SCOPE(TRACE_HASH);
+	const hashSlot &slot = table.slots[key & (table.slotCount - 1)];
+	unsigned long long data = slot.data.load(memory_order_relaxed);
+	unsigned long long check = slot.check.load(memory_order_relaxed);
+
+	if ((check ^ data) != key || check == 0) return false; // No luck
+
+	info = unpackEntry(data);
+	return true;
+}
+
+void storeTable(transpositionTable &table, unsigned long long key, const hashEntry &info)
+{
+	TRACE_SCOPE(TRACE_HASH);
+	hashSlot &slot = table.slots[key & (table.slotCount - 1)];
+	unsigned long long oldData = slot.data.load(memory_order_relaxed);
+	unsigned long long oldCheck = slot.check.load(memory_order_relaxed);
+
+	// Keep deeper results for the same position
+	if ((oldCheck ^ oldData) == key && unpackEntry(oldData).depth > info.depth) return;
 
-	if (res != _map.end()) // There is such a key - a hit
+	unsigned long long data = packEntry(info);
+	slot.data.store(data, memory_order_relaxed);
+	slot.check.store(key ^ data, memory_order_relaxed);
+}
+
+void initDistributedTable(int megabytes, int slaveCount, hugePageMode pages)
+{
+	distributedTable &table = _distributedTable;
+	table.slotCount = 0;
+	if (megabytes > 0)
+	{
+		size_t maxSlots = (size_t)megabytes * 1024 * 1024 / (2 * sizeof(unsigned long long));
+		table.slotCount = 1;
+		while (table.slotCount * 2 <= maxSlots) table.slotCount *= 2;
+	}
+	table.ownerCount = slaveCount;
+	table.pendingCount = 0;
+	if (table.slotCount == 0 || slaveCount == 0)
 	{
-		info = res->second;
-		return true;
+		table.slotCount = 0;
+		return;
 	}
 
-	return false; // No luck
+	size_t localSlots = _currentProcId < slaveCount ? table.slotCount : 0;
+	size_t localBytes = localSlots * 2 * sizeof(unsigned long long);
+	if (pages == HUGE_PAGES_OFF)
+	{
+		MPI_Win_allocate(localBytes, sizeof(unsigned long long), MPI_INFO_NULL, MPI_COMM_WORLD, &table.slots, &table.window);
+	}
+	else
+	{
+		// Every process must create the window the same way, there is no falling back to MPI's memory
+		if (!allocateTableMemory(table.memory, localBytes, pages))
+			MPI_Abort(MPI_COMM_WORLD, -1);
+		table.slots = (unsigned long long *)table.memory.address;
+		MPI_Win_create(table.slots, localBytes, sizeof(unsigned long long), MPI_INFO_NULL, MPI_COMM_WORLD, &table.window);
+	}
+	if (localSlots > 0 && table.slots != nullptr)
+		memset(table.slots, 0, localBytes);
+
+	// Passive target - any slave can read and write any part at any time, until the table is freed
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, table.window);
+	MPI_Win_sync(table.window);
+	MPI_Barrier(MPI_COMM_WORLD);
+}
+
+void freeDistributedTable()
+{
+	distributedTable &table = _distributedTable;
+	if (table.slotCount == 0) return;
+
+	flushDistributed(table);
+	MPI_Barrier(MPI_COMM_WORLD); // Nobody may still be accessing our part
+	MPI_Win_unlock_all(table.window);
+	MPI_Win_free(&table.window);
+	freeTableMemory(table.memory);
+	table.slots = nullptr;
+	table.slotCount = 0;
+}
+
+distributedTable *sharedTable()
+{
+	return _distributedTable.slotCount > 0 ? &_distributedTable : nullptr;
+}
+
+// The slave holding the entry for <key> and its slot there
+inline void locateKey(const distributedTable &table, unsigned long long key, int &owner, MPI_Aint &displacement)
+{
+	owner = (int)((key >> 40) % table.ownerCount);
+	displacement = (MPI_Aint)(key & (table.slotCount - 1)) * 2;
+}
+
+bool probeDistributed(distributedTable &table, unsigned long long key, hashEntry &info)
+{
+	TRACE_SCOPE(TRACE_COMM);
+	int owner;
+	MPI_Aint displacement;
+	locateKey(table, key, owner, displacement);
+
+	// Each of the two words is read atomically, a torn slot fails the check
+	unsigned long long slot[2];
+	MPI_Get_accumulate(nullptr, 0, MPI_UNSIGNED_LONG_LONG, slot, 2, MPI_UNSIGNED_LONG_LONG, owner, displacement, 2,
+					   MPI_UNSIGNED_LONG_LONG, MPI_NO_OP, table.window);
+	MPI_Win_flush(owner, table.window);
+
+	if ((slot[0] ^ slot[1]) != key || slot[0] == 0) return false;
+
+	info = unpackEntry(slot[1]);
+	return true;
+}
+
+void storeDistributed(distributedTable &table, unsigned long long key, const hashEntry &info)
+{
+	TRACE_SCOPE(TRACE_COMM);
+	if (table.pendingCount == REMOTE_STORE_BATCH)
+		flushDistributed(table);
+
+	int owner;
+	MPI_Aint displacement;
+	locateKey(table, key, owner, displacement);
+
+	unsigned long long *slot = table.pendingStores[table.pendingCount++];
+	slot[1] = packEntry(info);
+	slot[0] = key ^ slot[1];
+	MPI_Accumulate(slot, 2, MPI_UNSIGNED_LONG_LONG, owner, displacement, 2, MPI_UNSIGNED_LONG_LONG, MPI_REPLACE, table.window);
+}
+
+void flushDistributed(distributedTable &table)
+{
+	if (table.pendingCount == 0) return;
+	MPI_Win_flush_all(table.window);
+	table.pendingCount = 0;
 }
@@ -1,28 +1,116 @@
 #pragma once
+#ifndef HASHING_H
+#define HASHING_H
+#endif // !HASHING_H
+
 #include "stdafx.h"
-#include "board.h"
 #include "general.h"
+#include "hugepages.h"
+
+// Kinds of scores kept in the transposition table
+#define HASH_EXACT 0
+#define HASH_LOWER_BOUND 1	// The search failed high - the score is at least this
+#define HASH_UPPER_BOUND 2	// The search failed low - the score is at most this
+
+#define HASH_MIN_DEPTH 2	// Nodes closer to the leaves than this are not looked up or stored
+#define REMOTE_STORE_BATCH 64	// Stores to the distributed table are completed together, this many at a time
 
 struct hashEntry
 {
-	int maxDepth;			// The depth the result is coming from
-	gameMove bestMove;		// The best move found
+	short score;			// For the side to move
+	short depth;			// The remaining depth the score was searched to
+	char bound;				// HASH_EXACT, HASH_LOWER_BOUND or HASH_UPPER_BOUND
+	gameMove bestMove;		// The best move found(x < 0 if none)
+};
+
+/*
+	A slot of the transposition table, written without locks
+	<check> holds the key XORed with the data, so an entry torn by two threads writing at once doesn't match
+	either key and is treated as a miss
+*/
+struct hashSlot
+{
+	atomic<unsigned long long> check;
+	atomic<unsigned long long> data;
 };
 
 /*
-	Initialise the random bitstring table
-	N - board height
-	M - board width
+	Transposition table shared by all threads of a process
+	With one process per node it is shared by the whole node
 */
-void initZorbistTable(int N, int M);
+struct transpositionTable
+{
+	hashSlot *slots = nullptr;
+	size_t slotCount = 0;	// A power of 2, 0 if there is no table
+	tableMemory memory;		// Where the slots are
+};
+
+extern transpositionTable _transpositionTable;
+
+/*
+	Allocate the process' table, with up to <megabytes> MB(0 - no table), in the kind of pages <pages> asks for
+	Call before any search starts
+*/
+void initTranspositionTable(int megabytes, hugePageMode pages);
+
+// The process' table if there is one, null otherwise
+transpositionTable *processTable();
+
+// Empty every slot of <table>, so that a search doesn't start with the entries of the previous one. No search may be using it.
+void clearTable(transpositionTable &table);
 
 /*
-	Hash information for a given board state
+	Zobrist hash of <state>, on a board of the size this thread is working on, with <maxTurn> to move
+	The keys are the same in every process, for the same board size
 */
-void hashState(const board &state, hashEntry info);
+unsigned long long hashBoard(const board &state, bool maxTurn);
 
 /*
-	Get the entry for this state
-	return false state not in hash
+	Get the entry for <key>
+	return false if the key is not in the table
 */
-bool getInfoForState(const board &state, hashEntry &info);
\ No newline at end of file
+bool probeTable(const transpositionTable &table, unsigned long long key, hashEntry &info);
+
+// Store <info> for <key>, replacing entries for other keys and shallower ones for the same key
+void storeTable(transpositionTable &table, unsigned long long key, const hashEntry &info);
+
+/*
+	Transposition table spread over the slaves, in an MPI one-sided window
+	The entry for a key lives on the slave chosen by the key, in the same format as in the local table.
+	Probes wait for the owner's reply, stores are only queued and completed in batches.
+	Only the thread that called MPI_Init may use it.
+*/
+struct distributedTable
+{
+	MPI_Win window;
+	unsigned long long *slots = nullptr;	// This process' part - check and data for each slot
+	tableMemory memory;						// Where the part is, if it is not allocated by MPI
+	size_t slotCount = 0;					// Slots per slave, a power of 2, 0 if there is no table
+	int ownerCount = 0;						// Slaves holding a part
+	unsigned long long pendingStores[REMOTE_STORE_BATCH][2];	// Must stay unchanged until the stores are completed
+	int pendingCount = 0;
+};
+
+extern distributedTable _distributedTable;
+
+/*
+	Create the distributed table, with up to <megabytes> MB on each slave(0 - no table)
+	Each slave's part is in the kind of pages <pages> asks for - with normal pages, MPI allocates it
+	Collective - every process must call it, the master holds no part of the table
+*/
+void initDistributedTable(int megabytes, int slaveCount, hugePageMode pages);
+
+// Free the distributed table. Collective.
+void freeDistributedTable();
+
+// The distributed table if there is one, null otherwise
+distributedTable *sharedTable();
+
+// Get the entry for <key> from the slave that owns it, return false if the key is not in the table
+bool probeDistributed(distributedTable &table, unsigned long long key, hashEntry &info);
+
+// Queue <info> to be stored for <key>, replacing whatever its slot holds
+void storeDistributed(distributedTable &table, unsigned long long key, const hashEntry &info);
+
+// Complete the queued stores
+void flushDistributed(distributedTable &table);
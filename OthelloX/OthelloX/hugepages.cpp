@@ -0,0 +1,145 @@
+#include "stdafx.h"
+#include "hugepages.h"
+
+#ifdef __linux__
+	#include <sys/mman.h>
+#endif
+
+static const char *pageModeName(hugePageMode mode)
+{
+	switch (mode)
+	{
+	case HUGE_PAGES_EXPLICIT: return "explicit huge pages";
+	case HUGE_PAGES_TRANSPARENT: return "transparent huge pages";
+	default: return "normal pages";
+	}
+}
+
+#ifdef __linux__
+
+// Anonymous memory of <bytes>, starting on a huge page boundary, so that transparent huge pages can back all of it
+static void *mapAligned(size_t bytes)
+{
+	size_t paddedBytes = bytes + HUGE_PAGE_BYTES;
+	char *padded = (char *)mmap(nullptr, paddedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (padded == MAP_FAILED) return nullptr;
+
+	char *aligned = (char *)(((uintptr_t)padded + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1));
+	if (aligned > padded) munmap(padded, aligned - padded);
+	size_t tail = (padded + paddedBytes) - (aligned + bytes);
+	if (tail > 0) munmap(aligned + bytes, tail);
+	return aligned;
+}
+
+// How much of the mapping holding <address> is in transparent huge pages, from /proc/self/smaps
+static size_t transparentHugeBytes(const void *address)
+{
+	ifstream smaps("/proc/self/smaps");
+	string line;
+	bool inMapping = false;
+	while (getline(smaps, line))
+	{
+		unsigned long long start, end;
+		char dash;
+		stringstream header(line);
+		if (line.size() > 0 && isxdigit(line[0]) && (header >> hex >> start >> dash >> end) && dash == '-')
+		{
+			inMapping = (uintptr_t)address >= start && (uintptr_t)address < end;
+			continue;
+		}
+		if (inMapping && line.compare(0, 14, "AnonHugePages:") == 0)
+		{
+			stringstream value(line.substr(14));
+			size_t kilobytes = 0;
+			value >> kilobytes;
+			return kilobytes * 1024;
+		}
+	}
+	return 0;
+}
+
+bool allocateTableMemory(tableMemory &memory, size_t bytes, hugePageMode mode)
+{
+	freeTableMemory(memory);
+	if (bytes == 0) return true;
+	memory.bytes = bytes;
+	memory.mappedBytes = (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+
+	if (mode == HUGE_PAGES_EXPLICIT)
+	{
+		void *address = mmap(nullptr, memory.mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (address != MAP_FAILED)
+		{
+			memory.address = address;
+			memory.obtained = HUGE_PAGES_EXPLICIT;
+			return true;
+		}
+		LOG_ERR("No explicit huge pages for a table of " << bytes << " bytes(" << strerror(errno) << "), trying transparent ones");
+		mode = HUGE_PAGES_TRANSPARENT;
+	}
+
+	memory.address = mapAligned(memory.mappedBytes);
+	if (memory.address == nullptr)
+	{
+		LOG_ERR("Could not allocate a table of " << bytes << " bytes: " << strerror(errno));
+		memory = tableMemory();
+		return false;
+	}
+	memory.obtained = HUGE_PAGES_OFF;
+	if (mode == HUGE_PAGES_TRANSPARENT)
+	{
+		if (madvise(memory.address, memory.mappedBytes, MADV_HUGEPAGE) == 0)
+			memory.obtained = HUGE_PAGES_TRANSPARENT;
+		else
+			LOG_ERR("Transparent huge pages are not available(" << strerror(errno) << "), using normal pages");
+	}
+	return true;
+}
+
+void freeTableMemory(tableMemory &memory)
+{
+	if (memory.address != nullptr)
+		munmap(memory.address, memory.mappedBytes);
+	memory = tableMemory();
+}
+
+string tableMemoryReport(const tableMemory &memory)
+{
+	stringstream report;
+	report << memory.bytes / (1024 * 1024) << " MB in " << pageModeName(memory.obtained);
+	if (memory.obtained == HUGE_PAGES_TRANSPARENT)
+		report << "(" << transparentHugeBytes(memory.address) / (1024 * 1024) << " MB backed by huge pages so far)";
+	return report.str();
+}
+
+#else
+
+bool allocateTableMemory(tableMemory &memory, size_t bytes, hugePageMode mode)
+{
+	freeTableMemory(memory);
+	if (bytes == 0) return true;
+	if (mode != HUGE_PAGES_OFF)
+		LOG_ERR("Huge pages are only supported on Linux, using normal pages");
+	memory.address = calloc(bytes, 1);
+	if (memory.address == nullptr)
+	{
+		LOG_ERR("Could not allocate a table of " << bytes << " bytes");
+		return false;
+	}
+	memory.bytes = bytes;
+	memory.mappedBytes = bytes;
+	return true;
+}
+
+void freeTableMemory(tableMemory &memory)
+{
+	free(memory.address);
+	memory = tableMemory();
+}
+
+string tableMemoryReport(const tableMemory &memory)
+{
+	return to_string(memory.bytes / (1024 * 1024)) + " MB in " + pageModeName(memory.obtained);
+}
+
+#endif
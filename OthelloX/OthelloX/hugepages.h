@@ -0,0 +1,38 @@
+#pragma once
+#ifndef HUGEPAGES_H
+#define HUGEPAGES_H
+#endif // !HUGEPAGES_H
+
+#include "stdafx.h"
+#include "general.h"
+
+/*
+Memory for the large tables, optionally in huge pages - a table of hundreds of MB in 4 KB pages misses the TLB on
+almost every probe. Asking for a kind of page that can't be had falls back to the next one down:
+	HUGE_PAGES_EXPLICIT    - pages reserved in hugetlbfs(vm.nr_hugepages), mapped with MAP_HUGETLB
+	HUGE_PAGES_TRANSPARENT - 2 MB aligned memory marked with madvise(MADV_HUGEPAGE) for transparent huge pages
+	HUGE_PAGES_OFF         - ordinary pages
+The memory comes zeroed. Linux only, elsewhere it is ordinary heap memory.
+*/
+
+#define HUGE_PAGE_BYTES (2 * 1024 * 1024)	// The default huge page size on x86-64 and most arm64 kernels
+
+struct tableMemory
+{
+	void *address = nullptr;
+	size_t bytes = 0;						// Asked for
+	size_t mappedBytes = 0;					// Rounded up to whole pages
+	hugePageMode obtained = HUGE_PAGES_OFF;	// What the memory is actually in(for transparent pages - what was asked for)
+};
+
+// Get <bytes> of zeroed memory in the kind of pages <mode> asks for, or the best kind below it. Return false if there is no memory at all.
+bool allocateTableMemory(tableMemory &memory, size_t bytes, hugePageMode mode);
+
+// Give the memory back - nothing if none was allocated
+void freeTableMemory(tableMemory &memory);
+
+/*
+What the table in <memory> ended up in, for the reports - for transparent pages, how much of it the kernel has
+backed with huge pages so far(touch the memory first)
+*/
+string tableMemoryReport(const tableMemory &memory);
@@ -0,0 +1,123 @@
+#include "stdafx.h"
+#include "kernels.h"
+#include "boardcore.h"
+#include "evalcore.h"
+#include "bitboard.h"
+
+template<int M, int N>
+boardKernels makeKernels()
+{
+	boardKernels kernels;
+	kernels.isValidMove = isValidMoveT<M, N>;
+	kernels.getMoves = getMovesT<M, N>;
+	kernels.applyMove = applyMoveT<M, N>;
+	kernels.discCount = discCountT<M, N>;
+	kernels.stableDiscs = stableDiscsT<M, N>;
+	kernels.staticScore = staticScoreT<M, N>;
+	return kernels;
+}
+
+// Move and stability kernels on W-word bitboards, the other evaluation kernels on arrays
+template<int W, int M, int N>
+boardKernels makeBitBoardKernels()
+{
+	boardKernels kernels = makeKernels<M, N>();
+	kernels.isValidMove = isValidMoveBB<W, M, N>;
+	kernels.getMoves = getMovesBB<W, M, N>;
+	kernels.applyMove = applyMoveBB<W, M, N>;
+	kernels.stableDiscs = stableDiscsBB<W, M, N>;
+	return kernels;
+}
+
+// The sizes we run, then bitboards of 1, 2 and 4 words for other sizes up to 16x16
+// Only boards wider or taller than that use the array kernels for everything
+static const boardKernels _kernels6x6 = makeBitBoardKernels<1, 6, 6>();
+static const boardKernels _kernels8x8 = makeBitBoardKernels<1, 8, 8>();
+static const boardKernels _kernels10x10 = makeBitBoardKernels<2, 10, 10>();
+static const boardKernels _kernelsBB1 = makeBitBoardKernels<1, 0, 0>();
+static const boardKernels _kernelsBB2 = makeBitBoardKernels<2, 0, 0>();
+static const boardKernels _kernelsBB4 = makeBitBoardKernels<4, 0, 0>();
+static const boardKernels _kernelsGeneric = makeKernels<0, 0>();
+
+thread_local boardKernels _kernels = _kernelsGeneric;
+thread_local const rayTable *_rays = nullptr;
+
+// The tables for one board size - built the first time a thread asks for that size, then shared
+struct boardGeometry
+{
+	rayTable rays;
+	bitGeometry<1> bb1;
+	bitGeometry<2> bb2;
+	bitGeometry<4> bb4;
+};
+
+static map<pair<int, int>, unique_ptr<boardGeometry>> _geometries;
+static mutex _geometriesLock;
+
+void initRayTables(rayTable &rays, int rows, int cols)
+{
+	rays.squares.clear();
+	rays.start = vector<int>(rows * cols * RAY_DIRECTIONS);
+	rays.length = vector<int>(rows * cols * RAY_DIRECTIONS);
+
+	for (int y = 0; y < rows; y++)
+	{
+		for (int x = 0; x < cols; x++)
+		{
+			int d = 0;
+			for (int i = -1; i <= 1; i++)
+			{
+				for (int j = -1; j <= 1; j++)
+				{
+					if (i == 0 && j == 0) continue;
+
+					int index = (y * cols + x) * RAY_DIRECTIONS + d;
+					rays.start[index] = rays.squares.size();
+					for (int p = y + i, q = x + j; p >= 0 && p < rows && q >= 0 && q < cols; p += i, q += j)
+						rays.squares.push_back(p * cols + q);
+					rays.length[index] = rays.squares.size() - rays.start[index];
+					d++;
+				}
+			}
+		}
+	}
+}
+
+// Get the tables for a board size, building them if no thread has used it yet
+static const boardGeometry *geometryFor(int rows, int cols)
+{
+	lock_guard<mutex> lock(_geometriesLock);
+	unique_ptr<boardGeometry> &geometry = _geometries[make_pair(rows, cols)];
+	if (!geometry)
+	{
+		geometry.reset(new boardGeometry());
+		initRayTables(geometry->rays, rows, cols);
+
+		int squares = rows * cols;
+		if (squares <= 64) initBitGeometry<1>(geometry->bb1, rows, cols);
+		else if (squares <= 128) initBitGeometry<2>(geometry->bb2, rows, cols);
+		else if (rows <= BB_MAX_SIDE && cols <= BB_MAX_SIDE) initBitGeometry<4>(geometry->bb4, rows, cols);
+	}
+	return geometry.get();
+}
+
+void setBoardSize(int rows, int cols)
+{
+	_M = rows;
+	_N = cols;
+
+	const boardGeometry *geometry = geometryFor(rows, cols);
+	_rays = &geometry->rays;
+	bitGeoPtr<1>() = &geometry->bb1;
+	bitGeoPtr<2>() = &geometry->bb2;
+	bitGeoPtr<4>() = &geometry->bb4;
+
+	int squares = rows * cols;
+	if (rows == 6 && cols == 6) _kernels = _kernels6x6;
+	else if (rows == 8 && cols == 8) _kernels = _kernels8x8;
+	else if (rows == 10 && cols == 10) _kernels = _kernels10x10;
+	else if (rows > BB_MAX_SIDE || cols > BB_MAX_SIDE) _kernels = _kernelsGeneric;
+	else if (squares <= 64) _kernels = _kernelsBB1;
+	else if (squares <= 128) _kernels = _kernelsBB2;
+	else _kernels = _kernelsBB4;
+}
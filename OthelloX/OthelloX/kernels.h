@@ -0,0 +1,30 @@
+#pragma once
+#ifndef KERNELS_H
+#define KERNELS_H
+#endif // !KERNELS_H
+
+#include "stdafx.h"
+#include "general.h"
+
+// The hot board and evaluation routines for the current board size
+struct boardKernels
+{
+	bool (*isValidMove)(const piece *state, int y, int x, piece me);
+	void (*getMoves)(const piece *state, piece me, vector<gameMove> &moves);
+	void (*applyMove)(piece *state, int y, int x, piece me);
+	void (*discCount)(const piece *state, int &maxD, int &minD);
+	void (*stableDiscs)(const piece *state, int &maxStable, int &minStable);
+	int (*staticScore)(const piece *state, const piece *weights);
+};
+
+// The kernels for this thread's board size
+extern thread_local boardKernels _kernels;
+
+/*
+Set the board size(_M, _N) and select the kernels compiled for it
+There are specialisations for 6x6, 8x8 and 10x10 boards, other sizes use the generic kernels
+Moves are generated on bitboards for boards up to 16x16 and on arrays for larger ones
+Must be called whenever the board size changes. The size and kernels are per thread, so every thread that
+works on boards must call it first - threads can work on different sizes at the same time
+*/
+void setBoardSize(int rows, int cols);
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "parsing.h"
+#include "hashing.h"
 
 
 // Trim a string from starting and trailing characters
@@ -104,8 +105,7 @@ bool parseBoardFile(const char * filename, board &state, evalParams &params)
 			int commaIndex = arg.find(",");
 			try
 			{
-				_M = stoi(arg.substr(0, commaIndex));
-				_N = stoi(arg.substr(commaIndex + 1));
+				setBoardSize(stoi(arg.substr(0, commaIndex)), stoi(arg.substr(commaIndex + 1)));
 
 
 				// Initialise board with zeros
@@ -213,6 +213,49 @@ bool parseBoardFile(const char * filename, board &state, evalParams &params)
 }
 
 
+// Parse a "ProbCut<depth> : shallow depth, a, b, sigma" line and add the check to <params>
+bool parseProbCut(const string &param, const string &arg, evalParams &params)
+{
+	probCutCheck check;
+	int depth;
+	char comma[3];
+	try
+	{
+		depth = stoi(param.substr(strlen(PRS_PROBCUT)));
+	}
+	catch (const std::exception&)
+	{
+		LOG_ERR("Bad depth for ProbCut: " << param);
+		return false;
+	}
+	istringstream is(arg);
+	if (!(is >> check.shallowDepth >> comma[0] >> check.a >> comma[1] >> check.b >> comma[2] >> check.sigma) ||
+		comma[0] != ',' || comma[1] != ',' || comma[2] != ',')
+	{
+		LOG_ERR("Bad argument for " << param << "(specify shallow depth, a, b, sigma): " << arg);
+		return false;
+	}
+
+	if (depth < 2 || depth >= PROBCUT_MAX_DEPTH || check.shallowDepth < 0 || check.shallowDepth >= depth || check.a <= 0 || check.sigma < 0)
+	{
+		LOG_ERR("Invalid ProbCut check " << param << ": " << arg << "(depths must be 0 <= shallow < depth < " << PROBCUT_MAX_DEPTH
+				<< ", a > 0 and sigma >= 0)");
+		return false;
+	}
+	if (params.probCutCount[depth] == PROBCUT_MAX_CHECKS)
+	{
+		LOG_ERR("Too many ProbCut checks for depth " << depth << ", at most " << PROBCUT_MAX_CHECKS);
+		return false;
+	}
+
+	// Keep the checks shallowest first, so that the cheap ones get the first chance to cut
+	int i = params.probCutCount[depth]++;
+	for (; i > 0 && params.probCut[depth][i - 1].shallowDepth > check.shallowDepth; i--)
+		params.probCut[depth][i] = params.probCut[depth][i - 1];
+	params.probCut[depth][i] = check;
+	return true;
+}
+
 bool parseParamsFile(const char * filename, evalParams &params)
 {
 	// Flags, indicating whether we found the respective params in the file
@@ -388,6 +431,203 @@ bool parseParamsFile(const char * filename, evalParams &params)
 				return false;
 			}
 		}
+		else if (param.compare(PRS_METRICS_INTERVAL) == 0)
+		{
+			try
+			{
+				params.metricsInterval = stof(arg);
+			}
+			catch (const std::exception&)
+			{
+				LOG_ERR("Bad argument for metrics interval: " << arg);
+				return false;
+			}
+		}
+		else if (param.compare(PRS_MULTI_PV) == 0)
+		{
+			try
+			{
+				params.multiPV = stoi(arg);
+			}
+			catch (const std::exception&)
+			{
+				LOG_ERR("Bad argument for multi-PV: " << arg);
+				return false;
+			}
+			if (params.multiPV < 0)
+			{
+				LOG_ERR("Multi-PV must be 0 or more: " << arg);
+				return false;
+			}
+		}
+		else if (param.compare(PRS_THREADS) == 0)
+		{
+			try
+			{
+				params.threads = stoi(arg);
+			}
+			catch (const std::exception&)
+			{
+				LOG_ERR("Bad argument for threads: " << arg);
+				return false;
+			}
+			if (params.threads < 0)
+			{
+				LOG_ERR("Threads must be 0 or more: " << arg);
+				return false;
+			}
+		}
+		else if (param.compare(PRS_HASH_SIZE) == 0)
+		{
+			try
+			{
+				params.hashSize = stoi(arg);
+			}
+			catch (const std::exception&)
+			{
+				LOG_ERR("Bad argument for hash size: " << arg);
+				return false;
+			}
+			if (params.hashSize < 0)
+			{
+				LOG_ERR("Hash size must be 0 or more: " << arg);
+				return false;
+			}
+		}
+		else if (param.compare(PRS_SHARED_HASH_SIZE) == 0)
+		{
+			try
+			{
+				params.sharedHashSize = stoi(arg);
+			}
+			catch (const std::exception&)
+			{
+				LOG_ERR("Bad argument for shared hash size: " << arg);
+				return false;
+			}
+			if (params.sharedHashSize < 0)
+			{
+				LOG_ERR("Shared hash size must be 0 or more: " << arg);
+				return false;
+			}
+		}
+		else if (param.compare(PRS_SHARED_HASH_DEPTH) == 0)
+		{
+			try
+			{
+				params.sharedHashDepth = stoi(arg);
+			}
+			catch (const std::exception&)
+			{
+				LOG_ERR("Bad argument for shared hash depth: " << arg);
+				return false;
+			}
+			if (params.sharedHashDepth < HASH_MIN_DEPTH)
+			{
+				LOG_ERR("Shared hash depth must be " << HASH_MIN_DEPTH << " or more: " << arg);
+				return false;
+			}
+		}
+		else if (param.compare(PRS_MAX_JOB_SHARE) == 0)
+		{
+			try
+			{
+				params.maxJobShare = stof(arg);
+			}
+			catch (const std::exception&)
+			{
+				LOG_ERR("Bad argument for max job share: " << arg);
+				return false;
+			}
+			if (params.maxJobShare < 0 || params.maxJobShare > 1)
+			{
+				LOG_ERR("Max job share must be between 0 and 1: " << arg);
+				return false;
+			}
+		}
+		else if (param.compare(PRS_PLACEMENT) == 0)
+		{
+			if (arg.compare(PRS_PLACEMENT_NONE) == 0)
+				params.placement = PLACE_NONE;
+			else if (arg.compare(PRS_PLACEMENT_COMPACT) == 0)
+				params.placement = PLACE_COMPACT;
+			else if (arg.compare(PRS_PLACEMENT_SCATTER) == 0)
+				params.placement = PLACE_SCATTER;
+			else if (arg.compare(PRS_PLACEMENT_NUMA) == 0)
+				params.placement = PLACE_NUMA;
+			else
+			{
+				LOG_ERR("Bad argument for placement: " << arg);
+				return false;
+			}
+		}
+		else if (param.compare(PRS_HUGE_PAGES) == 0)
+		{
+			if (arg.compare(PRS_HUGE_PAGES_OFF) == 0)
+				params.hugePages = HUGE_PAGES_OFF;
+			else if (arg.compare(PRS_HUGE_PAGES_TRANSPARENT) == 0)
+				params.hugePages = HUGE_PAGES_TRANSPARENT;
+			else if (arg.compare(PRS_HUGE_PAGES_EXPLICIT) == 0)
+				params.hugePages = HUGE_PAGES_EXPLICIT;
+			else
+			{
+				LOG_ERR("Bad argument for huge pages: " << arg);
+				return false;
+			}
+		}
+		else if (param.compare(PRS_STABILITY_CUTOFF) == 0)
+		{
+			try
+			{
+				params.useStabilityCutoff = (bool) stoi(arg);
+			}
+			catch (const std::exception&)
+			{
+				LOG_ERR("Bad argument for stability cutoff(specify 0 or 1): " << arg);
+				return false;
+			}
+		}
+		else if (param.compare(PRS_PROBCUT_THRESHOLD) == 0)
+		{
+			try
+			{
+				params.probCutThreshold = stof(arg);
+			}
+			catch (const std::exception&)
+			{
+				LOG_ERR("Bad argument for ProbCut threshold: " << arg);
+				return false;
+			}
+		}
+		else if (param.compare(0, strlen(PRS_PROBCUT), PRS_PROBCUT) == 0)
+		{
+			if (!parseProbCut(param, arg, params)) return false;
+		}
+		else if (param.compare(PRS_CORNER_WEIGHT) == 0 || param.compare(PRS_X_SQUARE_WEIGHT) == 0 || param.compare(PRS_C_SQUARE_WEIGHT) == 0 ||
+				 param.compare(PRS_EDGE_SQUARE_WEIGHT) == 0 || param.compare(PRS_INNER_SQUARE_WEIGHT) == 0)
+		{
+			int weight;
+			try
+			{
+				weight = stoi(arg);
+			}
+			catch (const std::exception&)
+			{
+				LOG_ERR("Bad argument for " << param << ": " << arg);
+				return false;
+			}
+			if (weight < SCHAR_MIN || weight > SCHAR_MAX)
+			{
+				LOG_ERR("Weight out of range for " << param << ": " << arg);
+				return false;
+			}
+
+			if (param.compare(PRS_CORNER_WEIGHT) == 0) params.cornerWeight = weight;
+			else if (param.compare(PRS_X_SQUARE_WEIGHT) == 0) params.xSquareWieght = weight;
+			else if (param.compare(PRS_C_SQUARE_WEIGHT) == 0) params.cSquareWeight = weight;
+			else if (param.compare(PRS_EDGE_SQUARE_WEIGHT) == 0) params.edgeSquareWeight = weight;
+			else params.innerSquareWeight = weight;
+		}
 		else
 		{
 			LOG_WARNING("Unexpected token in parameters file: " << tokens[0]);
@@ -26,6 +26,30 @@
 #define PRS_LOAD_FACTOR "LoadFactor" 			// integer
 #define PRS_STATIC_EVAL "StaticEvaluation" 		// 0 or 1
 #define PRS_PARALLEL_SEARCH "ParallelSearch"	// 0 or 1
+#define PRS_CORNER_WEIGHT "CornerWeight"		// Static evaluation weights, -128 to 127
+#define PRS_X_SQUARE_WEIGHT "XSquareWeight"
+#define PRS_C_SQUARE_WEIGHT "CSquareWeight"
+#define PRS_EDGE_SQUARE_WEIGHT "EdgeSquareWeight"
+#define PRS_INNER_SQUARE_WEIGHT "InnerSquareWeight"
+#define PRS_METRICS_INTERVAL "MetricsInterval"	// seconds, 0 to only report at the end
+#define PRS_MULTI_PV "MultiPV"					// integer, 0 to score every root move exactly
+#define PRS_THREADS "Threads"					// integer, 0 for one per core
+#define PRS_HASH_SIZE "HashSize"				// MB, 0 for no transposition table
+#define PRS_SHARED_HASH_SIZE "SharedHashSize"	// MB per slave, 0 for no table shared by the slaves(needs Threads 1)
+#define PRS_SHARED_HASH_DEPTH "SharedHashDepth"	// integer, 2 or more
+#define PRS_MAX_JOB_SHARE "MaxJobShare"			// 0 to 1, 0 for 1 / minimum job count
+#define PRS_PLACEMENT "Placement"				// None, Compact, Scatter or NUMA
+#define PRS_PLACEMENT_NONE "None"
+#define PRS_PLACEMENT_COMPACT "Compact"
+#define PRS_PLACEMENT_SCATTER "Scatter"
+#define PRS_PLACEMENT_NUMA "NUMA"
+#define PRS_HUGE_PAGES "HugePages"				// Off, Transparent or Explicit
+#define PRS_HUGE_PAGES_OFF "Off"
+#define PRS_HUGE_PAGES_TRANSPARENT "Transparent"
+#define PRS_HUGE_PAGES_EXPLICIT "Explicit"
+#define PRS_STABILITY_CUTOFF "StabilityCutoff"	// 0 or 1
+#define PRS_PROBCUT_THRESHOLD "ProbCutThreshold"	// standard deviations
+#define PRS_PROBCUT "ProbCut"					// ProbCut<depth> : shallow depth, a, b, sigma
 
 /*
 Parse a position(ex: d4) for a board of size NxM
@@ -59,5 +83,6 @@ bool parseBoardFile(const char* filename, board &state, evalParams &params);
 	 StabilityWeight : 0.3  # Parameter for the board evaluator
 	 Color : Black			# return best moves for this color
 	 Timeout : 10			# your solution is allowed to run for this time
+	 ProbCut6 : 2, 1.0, 0, 40	# at depth 6, predict the score from a depth 2 search(repeat for multi-ProbCut)
 */
 bool parseParamsFile(const char* filename, evalParams &params);
\ No newline at end of file
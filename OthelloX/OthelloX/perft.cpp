@@ -0,0 +1,79 @@
+#include "stdafx.h"
+#include "perft.h"
+#include "timing.h"
+
+// Known leaf counts from the standard 8x8 starting position, indexed by depth
+static const unsigned long long _knownPerft8x8[] = { 1ULL, 4ULL, 12ULL, 56ULL, 244ULL, 1396ULL, 8200ULL, 55092ULL, 390216ULL,
+	3005288ULL, 24571284ULL, 212258800ULL, 1939886636ULL, 18429641748ULL, 184042084512ULL };
+#define KNOWN_PERFT_DEPTHS (int)(sizeof(_knownPerft8x8) / sizeof(_knownPerft8x8[0]))
+
+unsigned long long perft(const board &state, int depth, bool maxTurn, bool passed)
+{
+	if (depth == 0) return 1;
+
+	vector<gameMove> moves = getMoves(state, maxTurn);
+	if (moves.size() == 0)
+	{
+		// Neither player can move - the game is over
+		if (passed) return 1;
+		return perft(state, depth - 1, !maxTurn, true);
+	}
+
+	// No need to make the last moves, we only count them
+	if (depth == 1) return moves.size();
+
+	unsigned long long nodes = 0;
+	for (gameMove mv : moves)
+		nodes += perft(applyMove(state, mv, maxTurn), depth - 1, !maxTurn, false);
+
+	return nodes;
+}
+
+unsigned long long perft(const board &state, int depth, bool maxTurn)
+{
+	return perft(state, depth, maxTurn, false);
+}
+
+// Is this the standard 8x8 starting position(in either colour)?
+bool isStandardStart(const board &state)
+{
+	if (_M != 8 || _N != 8) return false;
+
+	board start;
+	makeEmptyBoard(start);
+	boardAssign(start, 3, 3, BRD_MIN_DISC);
+	boardAssign(start, 4, 4, BRD_MIN_DISC);
+	boardAssign(start, 3, 4, BRD_MAX_DISC);
+	boardAssign(start, 4, 3, BRD_MAX_DISC);
+
+	return state == start || state == flipAll(start);
+}
+
+bool runPerft(const board &state, int maxDepth, bool maxTurn)
+{
+	bool check = isStandardStart(state);
+	bool passed = true;
+
+	cout << "depth, nodes, seconds, nodesPerSec" << (check ? ", expected" : "") << endl;
+	for (int depth = 1; depth <= maxDepth; depth++)
+	{
+		timePoint before = timeNow();
+		unsigned long long nodes = perft(state, depth, maxTurn);
+		double seconds = nsBetween(before, timeNow()) / BLN_DOUBLE;
+
+		cout << depth << ", " << nodes << ", " << seconds << ", " << (seconds > 0 ? nodes / seconds : 0);
+		if (check && depth < KNOWN_PERFT_DEPTHS)
+		{
+			cout << ", " << _knownPerft8x8[depth];
+			if (nodes != _knownPerft8x8[depth])
+			{
+				cout << " MISMATCH";
+				passed = false;
+			}
+		}
+		cout << endl;
+	}
+
+	if (check) cout << "Perft " << (passed ? "passed" : "FAILED") << endl;
+	return passed;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#ifndef PERFT_H
+#define PERFT_H
+#endif // !PERFT_H
+
+#include "stdafx.h"
+#include "general.h"
+#include "board.h"
+
+// Command line mode for the move generator benchmark
+#define MODE_PERFT "perft"
+
+/*
+Count the leaf nodes of the game tree of depth <depth>, rooted at <state>
+A pass counts as a move. A game that ends before <depth> counts as one leaf
+*/
+unsigned long long perft(const board &state, int depth, bool maxTurn);
+
+/*
+Run perft for depths 1 to <maxDepth> from <state>, reporting node counts and nodes per second
+If <state> is the standard 8x8 starting position, the counts are checked against the known values
+returns false if a count does not match
+*/
+bool runPerft(const board &state, int maxDepth, bool maxTurn);
@@ -2,12 +2,17 @@
 #include "search.h"
 #include "timing.h"
 #include "stats.h"
+#include "trace.h"
+#include "kernels.h"
+
+// The job this slave is working on, to tell stop messages for it from late ones for its earlier jobs
+static int _runningJobId = -1;
 
 /*
 ********* MASTER FUNCTIONS *********
 */
 
-void masterMain(board initState, int slaveCount)
+searchSummary masterMain(board initState, int slaveCount, bool writeReports)
 {
     timePoint before, after;
     timePoint masterStart = timeNow();
@@ -20,78 +25,159 @@ void masterMain(board initState, int slaveCount)
     long long scorePropagationTime = 0;
 
     // Generate some nodes
-    vector<stateNode> nodes;
+    nodeArena arena;
+    vector<stateNode> &nodes = arena.nodes;
     queue<int> jobQueue;
     before = timeNow();
-    generateNodes(initState, slaveCount * _parameters.loadFactor, nodes, jobQueue);
+    generateNodes(initState, slaveCount * _parameters.loadFactor, arena, jobQueue);
     after = timeNow();
     nodeGenerationTime = nsBetween(before, after);
 
     int jobsToComplete = jobQueue.size(); // How many jobs do we have in the pool at the start
-    cout << "Job count: " << jobsToComplete << endl;
+    int rootMoveCount = nodes[0].pendingChildren; // The root is expanded first, its children are nodes 1 to rootMoveCount
+    int runningJobs = 0;
+    int cancelledJobs = 0;
+    double queuedCost = 0; // Estimated cost of the jobs not sent yet
+    vector<int> jobIds; // All of the jobs, to count the unfinished ones at the end
+    for (int i = 0; i < jobsToComplete; i++)
+    {
+        queuedCost += nodes[jobQueue.front()].cost;
+        jobIds.push_back(jobQueue.front());
+        jobQueue.push(jobQueue.front());
+        jobQueue.pop();
+    }
+    if (writeReports)
+        cout << "Job count: " << jobsToComplete << ", largest job's share of the estimated work: "
+             << (jobsToComplete > 0 && queuedCost > 0 ? nodes[jobQueue.front()].cost / queuedCost : 0) << endl;
     vector<vector<slaveStats>> jobStats(slaveCount, vector<slaveStats>(0)); // Used to store statistics about each job per slave
+    vector<workerMetrics> metrics(slaveCount); // Running totals per slave
+    timePoint lastMetricsReport = masterStart;
+
+    // Split the board budget between the jobs as they are sent, in proportion to their estimated cost,
+    // handing what a job did not use on to later ones
+    long long boardsUsed = 0;
+    long long budgetOutstanding = 0; // Given to jobs that are still running
+    vector<int> jobBudget(nodes.size(), 0);
+    auto nextJobBudget = [&](int nodeId) {
+        long long left = _parameters.maxBoards - boardsUsed - budgetOutstanding;
+        double share = queuedCost > 0 ? min(1.0, nodes[nodeId].cost / queuedCost) : 1.0 / (jobQueue.size() + 1); // The queue included this job
+        queuedCost -= nodes[nodeId].cost;
+        jobBudget[nodeId] = (int)max(1LL, (long long)(left * share));
+        budgetOutstanding += jobBudget[nodeId];
+        return jobBudget[nodeId];
+    };
 
-    // Get the depth of a node at <nodeIdx>
-    auto getDepth = [nodes](int nodeIdx) {
-        if (nodeIdx == 0)
-            return 0;
-        else
+    // Fault tolerance - a job may be running on more than one slave, the first result counts
+    vector<int> slaveJob(slaveCount, -1); // The job each slave is working on
+    vector<timePoint> slaveJobStart(slaveCount);
+    vector<int> jobCopies(nodes.size(), 0); // How many slaves are working on each job
+    vector<bool> jobDone(nodes.size(), false);
+    vector<int> idleSlaves; // Out of jobs, kept in case a straggler's job needs a copy
+    double completedSeconds = 0; // Time and estimated cost of the finished jobs, for how long a job is expected to take
+    double completedCost = 0;
+    int speculativeJobs = 0;
+    int duplicateResults = 0;
+    timePoint giveUpAt = deadlineAfter(searchDeadline(), RESULT_GRACE_SECONDS);
+    vector<int> rootGuess(rootMoveCount + 1, INT_MIN); // Per root move, the lowest score of its jobs that were cut short(INT_MIN - none)
+    // Stop messages, one buffer per slave as they are sent without waiting
+    vector<int> stopJobId(slaveCount);
+    vector<MPI_Request> stopRequests(slaveCount, MPI_REQUEST_NULL);
+    vector<bool> stopSent(slaveCount, false); // For the slave's current job
+    int stoppedJobs = 0;
+
+    auto dispatch = [&](int slaveId, int nodeId, int maxBoards) {
+        totalSendTime += sendJob(arena, nodeId, slaveId, maxBoards);
+        slaveJob[slaveId] = nodeId;
+        slaveJobStart[slaveId] = timeNow();
+        stopSent[slaveId] = false;
+        jobCopies[nodeId]++;
+        runningJobs++;
+    };
+
+    auto dismissSlave = [&](int slaveId) {
+        short workFlag = FLAG_MORE_JOBS_FALSE;
+        before = timeNow();
+        MPI_Send(&workFlag, 1, MPI_SHORT, slaveId, Tags::MORE_JOBS, MPI_COMM_WORLD);
+        after = timeNow();
+        totalSendTime += nsBetween(before, after);
+    };
+
+    // Send the next job that is still needed to <slaveId>, or leave it idle
+    // Jobs under cut root moves are dropped - once the root's score is decided, that is all of them
+    // Past the deadline no more jobs are sent, they would stop straight away - the finished ones give the answer
+    auto sendNextJob = [&](int slaveId) {
+        while (jobQueue.size() > 0 && timeNow() <= searchDeadline())
         {
-            int res = 0;
-            while (nodeIdx != 0)
+            int nodeId = jobQueue.front();
+            jobQueue.pop();
+            if (nodes[nodes[nodeId].rootMove].isCut)
             {
-                nodeIdx = nodes[nodeIdx].parentIndex;
-                res++;
+                queuedCost -= nodes[nodeId].cost;
+                cancelledJobs++;
+                continue;
             }
-            return res;
+
+            dispatch(slaveId, nodeId, nextJobBudget(nodeId));
+            return;
         }
+        idleSlaves.push_back(slaveId);
     };
 
-    if (nodes.size() == 1) // We only have the root - we have no possible moves
-    {
-        cout << "{ na }";
-        // Tell slaves there is no work to do
-        for (int slaveId = 0; slaveId < slaveCount; slaveId++)
+    // Give idle slaves copies of the jobs that are taking much longer than expected
+    auto speculate = [&]() {
+        timePoint now = timeNow();
+        if (idleSlaves.size() == 0 || completedCost <= 0 || now > searchDeadline()) return;
+        double secondsPerCost = completedSeconds / completedCost;
+        for (int slaveId = 0; slaveId < slaveCount && idleSlaves.size() > 0; slaveId++)
         {
-            short workFlag = FLAG_MORE_JOBS_FALSE;
-            before = timeNow();
-            MPI_Send(&workFlag, 1, MPI_SHORT, slaveId, Tags::MORE_JOBS, MPI_COMM_WORLD);
-            after = timeNow();
-            totalSendTime += nsBetween(before, after);
+            int nodeId = slaveJob[slaveId];
+            if (nodeId < 0 || jobCopies[nodeId] > 1 || jobDone[nodeId] || nodes[nodes[nodeId].rootMove].isCut) continue;
+            double expected = max(STRAGGLER_MIN_SECONDS, STRAGGLER_FACTOR * secondsPerCost * nodes[nodeId].cost);
+            if (nsBetween(slaveJobStart[slaveId], now) / BLN_DOUBLE < expected) continue;
+
+            int idleSlave = idleSlaves.back();
+            idleSlaves.pop_back();
+            budgetOutstanding += jobBudget[nodeId];
+            dispatch(idleSlave, nodeId, jobBudget[nodeId]);
+            speculativeJobs++;
         }
-        return;
-    }
+    };
 
-    // Send a job to each slave
-    for (int slaveId = 0; slaveId < slaveCount; slaveId++)
-    {
-        if (jobQueue.size() > 0)
-        {
-            int nodeId = jobQueue.front();
-            jobQueue.pop();
+    // Tell <slaveId> to stop its job - its result is still received as usual
+    auto stopJob = [&](int slaveId) {
+        MPI_Wait(&stopRequests[slaveId], MPI_STATUS_IGNORE); // The buffer may still be in use by the last stop
+        stopJobId[slaveId] = slaveJob[slaveId];
+        MPI_Isend(&stopJobId[slaveId], 1, MPI_INT, slaveId, Tags::STOP_JOB, MPI_COMM_WORLD, &stopRequests[slaveId]);
+        stopSent[slaveId] = true;
+        stoppedJobs++;
+    };
 
-            totalSendTime += sendJob(nodes[nodeId], nodeId, slaveId, getDepth(nodeId));
-        }
-        else // If somehow the number of slaves is greater than the pool size, we tell the other slaves there is no work for them
+    // Stop the jobs whose results can no longer matter - under a cut root move, or finished by another slave
+    auto stopUselessJobs = [&]() {
+        for (int slaveId = 0; slaveId < slaveCount; slaveId++)
         {
-            short workFlag = FLAG_MORE_JOBS_FALSE;
-            before = timeNow();
-            MPI_Send(&workFlag, 1, MPI_SHORT, slaveId, Tags::MORE_JOBS, MPI_COMM_WORLD);
-            after = timeNow();
-            totalSendTime += nsBetween(before, after);
+            int nodeId = slaveJob[slaveId];
+            if (nodeId >= 0 && !stopSent[slaveId] && (jobDone[nodeId] || nodes[nodes[nodeId].rootMove].isCut))
+                stopJob(slaveId);
         }
-    }
+    };
 
-    // While we haven't received results for all jobs
-    while (jobsToComplete > 0)
-    {
-        // Wait for a slave to signal it's done, get the result from it
-        int slaveId;
+    // Is there a result waiting?
+    auto resultReady = [&]() {
+        int ready = 0;
+        MPI_Iprobe(MPI_ANY_SOURCE, Tags::SEARCH_JOB_RESULT, MPI_COMM_WORLD, &ready, MPI_STATUS_IGNORE);
+        return ready != 0;
+    };
+
+    // Receive a result and the stats that come with it, and free the slave that sent them
+    auto collectResult = [&](int &slaveId) {
         before = timeNow();
         jobResult result = receiveResult(slaveId); // Get result
         after = timeNow();
         totalRecvTime += nsBetween(before, after);
-        jobsToComplete--;
+        runningJobs--;
+        jobCopies[result.jobId]--;
+        slaveJob[slaveId] = -1;
 
         // Receive stats
         slaveStats stats;
@@ -100,58 +186,175 @@ void masterMain(board initState, int slaveCount)
         after = timeNow();
         totalRecvStatsTime += nsBetween(before, after);
         jobStats[slaveId].push_back(stats);
+        updateWorkerMetrics(metrics[slaveId], stats);
+        boardsUsed += stats.boardsEvaluated;
+        budgetOutstanding -= jobBudget[result.jobId];
+        return result;
+    };
+
+    if (nodes.size() == 1) // We only have the root - we have no possible moves
+    {
+        cout << "{ na }";
+        // Tell slaves there is no work to do
+        for (int slaveId = 0; slaveId < slaveCount; slaveId++)
+        {
+            dismissSlave(slaveId);
+        }
+        return summariseJobStats(jobStats, nsBetween(masterStart, timeNow()));
+    }
 
-        // Update the node with the result
-        nodes[result.jobId].bestScore = result.score;
+    // Send a job to each slave - if somehow the number of slaves is greater than the pool size, the others are left idle
+    for (int slaveId = 0; slaveId < slaveCount; slaveId++)
+    {
+        sendNextJob(slaveId);
+    }
 
-        if (jobQueue.size() > 0) // If we have more jobs send one to the slave that just completed a job
+    // While slaves are still working on jobs
+    while (runningJobs > 0)
+    {
+        // Report on the slaves periodically, if asked to
+        timePoint now = timeNow();
+        if (_parameters.metricsInterval > 0 && nsBetween(lastMetricsReport, now) >= _parameters.metricsInterval * BLN_DOUBLE)
         {
-            // Some a-b pruning can take place here
-            // Send the slave a job
-            int nodeId = jobQueue.front();
-            jobQueue.pop();
-            totalSendTime += sendJob(nodes[nodeId], nodeId, slaveId, getDepth(nodeId));
+            printWorkerMetrics(metrics, nsBetween(masterStart, now), false);
+            lastMetricsReport = now;
         }
-        else // Otherwise, tell the slave it won't be getting more work and get stats from it
+
+        // Wait for a slave to signal it's done - up to the deadline, copying straggling jobs meanwhile
+        if (!resultReady())
         {
-            short workFlag = FLAG_MORE_JOBS_FALSE;
+            if (timeNow() > giveUpAt)
+                break;
+            speculate();
             before = timeNow();
-            MPI_Send(&workFlag, 1, MPI_SHORT, slaveId, Tags::MORE_JOBS, MPI_COMM_WORLD);
-            after = timeNow();
-            totalSendTime += nsBetween(before, after);
+            this_thread::sleep_for(chrono::microseconds(RESULT_POLL_US));
+            totalRecvTime += nsBetween(before, timeNow());
+            continue;
         }
+
+        int slaveId;
+        jobResult result = collectResult(slaveId);
+        timePoint jobStart = slaveJobStart[slaveId];
+
+        // Update the node with the result, and the scores above it - unless another slave got there first
+        // A job cut short(by the deadline, or stopped as useless) stays unfinished - its score is only a guess
+        before = timeNow();
+        if (jobDone[result.jobId])
+        {
+            duplicateResults++;
+        }
+        else if (result.stopped)
+        {
+            int rootMove = nodes[result.jobId].rootMove;
+            rootGuess[rootMove] = rootGuess[rootMove] == INT_MIN ? result.score : min(rootGuess[rootMove], result.score);
+        }
+        else
+        {
+            jobDone[result.jobId] = true;
+            completedSeconds += nsBetween(jobStart, after) / BLN_DOUBLE;
+            completedCost += nodes[result.jobId].cost;
+            if (!nodes[nodes[result.jobId].rootMove].isCut)
+            {
+                nodes[result.jobId].bestScore = result.score;
+                nodes[result.jobId].pv = result.pv;
+                propagateResult(nodes, result.jobId);
+                cutRootMoves(nodes, rootMoveCount);
+            }
+        }
+        scorePropagationTime += nsBetween(before, timeNow());
+
+        // If we have more jobs send one to the slave that just completed a job
+        sendNextJob(slaveId);
+        stopUselessJobs();
     }
 
-    before = timeNow();
+    // Jobs under root moves that are still in the running, and didn't finish - only when the deadline cut the search short
+    int jobsAtDeadline = 0;
+    for (int nodeId : jobIds)
+    {
+        if (!jobDone[nodeId] && !nodes[nodes[nodeId].rootMove].isCut)
+            jobsAtDeadline++;
+    }
+    bool deadlineHit = jobsAtDeadline > 0;
+
+    // What is our best move? Exact scores first, then upper bounds, then the moves no job has finished for(only after the deadline) -
+    // those by the lowest score their cut short jobs got, a guess but better than none
+    auto scoreRank = [&nodes](int nodeId) { return nodes[nodeId].isFinal && !nodes[nodeId].isCut ? 0 : (nodes[nodeId].bestScore != INT_MAX ? 1 : 2); };
+    vector<int> rootOrder;
+    for (int nodeId = 1; nodeId <= rootMoveCount; nodeId++)
+        rootOrder.push_back(nodeId);
+    stable_sort(rootOrder.begin(), rootOrder.end(), [&](int left, int right) {
+        if (scoreRank(left) != scoreRank(right)) return scoreRank(left) < scoreRank(right);
+        if (scoreRank(left) == 2) return rootGuess[left] > rootGuess[right];
+        return nodes[left].bestScore > nodes[right].bestScore; // Sort in descending order
+    });
+
     vector<valueMove> rootOrderedMoves;
-    // Go through the node list, updating parent nodes' scores
-    for (int nodeId = nodes.size() - 1; nodeId > 0; nodeId--)
+    for (int nodeId : rootOrder)
+    {
+        valueMove mv;
+        mv.move = nodes[nodeId].generatingMove;
+        mv.value = nodes[nodeId].bestScore;
+        mv.isExact = scoreRank(nodeId) == 0;
+        if (mv.isExact) mv.pv = nodeLine(nodes, nodeId);
+        rootOrderedMoves.push_back(mv);
+    }
+
+    // The answer is out before the slaves are let go - waiting for them must not hold it up
+    if (writeReports)
     {
-        stateNode currentNode = nodes[nodeId];
-        if (!currentNode.isMaxNode && currentNode.bestScore > nodes[currentNode.parentIndex].bestScore)
-            nodes[currentNode.parentIndex].bestScore = currentNode.bestScore;
-        else if(currentNode.isMaxNode && currentNode.bestScore < nodes[currentNode.parentIndex].bestScore)
-            nodes[currentNode.parentIndex].bestScore = currentNode.bestScore;
-        if (currentNode.parentIndex == 0) // This is a lvl 1 node
+        cout << "Root moves: " << endl;
+        for (valueMove mv : rootOrderedMoves)
         {
-            valueMove mv;
-            mv.move = currentNode.generatingMove;
-            mv.value = currentNode.bestScore;
-            rootOrderedMoves.push_back(mv);
+            if (!mv.isExact && mv.value == INT_MAX)
+            {
+                cout << (char)(mv.move.x + 'a') << mv.move.y + 1 << " with no score" << endl;
+                continue;
+            }
+            cout << (char)(mv.move.x + 'a') << mv.move.y + 1 << " with a score of " << (mv.isExact ? "" : "at most ") << mv.value;
+            if (mv.pv.size() > 0) cout << ", line: " << lineString(mv.pv);
+            cout << endl;
         }
+        cout << flush;
     }
 
-    // What is our best move?
-    sort(rootOrderedMoves.begin(), rootOrderedMoves.end(), [](const valueMove &left, const valueMove &right) {
-        return left.value > right.value; // Sort in descending order
-    });
-    after = timeNow();
-    scorePropagationTime = nsBetween(before, after);
+    // Let the slaves go - the ones still searching are told to stop, and dismissed once their result is in
+    // They get what is left of the timeout(between RESULT_DRAIN_MIN_SECONDS and RESULT_DRAIN_MAX_SECONDS) - one that still hasn't answered is hung
+    for (int slaveId : idleSlaves)
+    {
+        dismissSlave(slaveId);
+    }
+    for (int slaveId = 0; slaveId < slaveCount; slaveId++)
+    {
+        if (slaveJob[slaveId] >= 0 && !stopSent[slaveId])
+            stopJob(slaveId);
+    }
+    timePoint timeoutEnd = deadlineAfter(searchDeadline(), _parameters.timeout - moveTimeBudget(_parameters.timeout));
+    timePoint drainUntil = max(min(timeoutEnd, deadlineAfter(timeNow(), RESULT_DRAIN_MAX_SECONDS)), deadlineAfter(timeNow(), RESULT_DRAIN_MIN_SECONDS));
+    while (runningJobs > 0 && timeNow() < drainUntil)
+    {
+        if (!resultReady())
+        {
+            this_thread::sleep_for(chrono::microseconds(RESULT_POLL_US));
+            continue;
+        }
+        int slaveId;
+        collectResult(slaveId);
+        dismissSlave(slaveId);
+    }
+
+    MPI_Waitall(slaveCount, &stopRequests.front(), MPI_STATUSES_IGNORE);
 
     // Time the whole function
     masterEnd = timeNow();
     totalMasterTime = nsBetween(masterStart, masterEnd) - totalRecvStatsTime; // Do not take in account the time taken to communicate stats
 
+    searchSummary summary = summariseJobStats(jobStats, totalMasterTime);
+    summary.bestMove = rootOrderedMoves[0].move;
+    summary.abandonedJobs = runningJobs;
+    if (!writeReports)
+        return summary;
+
     writeStatsToFile(jobStats);
 
     cout << "---------" << endl;
@@ -160,6 +363,13 @@ void masterMain(board initState, int slaveCount)
     cout << "Master spent " << totalRecvStatsTime << " ns receiving stats" << endl;    
     cout << "Master spent " << nodeGenerationTime << " ns generating nodes" << endl;
     cout << "Master spent " << scorePropagationTime << " ns propagating scores" << endl;
+    cout << "Jobs cancelled: " << cancelledJobs << " of " << jobsToComplete << endl;
+    cout << "Jobs stopped early: " << stoppedJobs << endl;
+    cout << "Straggling jobs copied to idle slaves: " << speculativeJobs << ", results that came second: " << duplicateResults << endl;
+    if (deadlineHit)
+        cout << "Deadline reached with " << jobsAtDeadline << " jobs unfinished, answering from the finished ones" << endl;
+    if (runningJobs > 0)
+        cout << runningJobs << " jobs did not stop by the end of the timeout, the slaves running them are hung" << endl;
     cout << "Master spent " << totalMasterTime << " ns in total" << endl;
     cout << "Master sequential part: " << totalMasterTime - totalRecvTime - totalSendTime << endl;
     cout << "Sequential part / Total time: " <<  (totalMasterTime - totalRecvTime) / (double) totalMasterTime << endl;
@@ -167,75 +377,211 @@ void masterMain(board initState, int slaveCount)
     
     parallelSearchStatsToFile(jobStats, totalMasterTime, totalMasterTime - totalRecvTime - totalSendTime);
     outputStats(jobStats, totalMasterTime);
+    printWorkerMetrics(metrics, totalMasterTime, true);
+
+    return summary;
+}
+
+void propagateResult(vector<stateNode> &nodes, int nodeId)
+{
+    if (nodes[nodes[nodeId].rootMove].isCut) return;
+
+    nodes[nodeId].isFinal = true;
+    while (nodeId > 0)
+    {
+        const stateNode &node = nodes[nodeId];
+        stateNode &parent = nodes[node.parentIndex];
+        if ((!node.isMaxNode && node.bestScore > parent.bestScore) ||
+            (node.isMaxNode && node.bestScore < parent.bestScore))
+        {
+            parent.bestScore = node.bestScore;
+            parent.bestChild = nodeId;
+        }
+
+        // The parent's score is final once all of its children's are
+        if (--parent.pendingChildren > 0) return;
+        parent.isFinal = true;
+        nodeId = node.parentIndex;
+    }
+}
+
+int cutRootMoves(vector<stateNode> &nodes, int rootMoveCount)
+{
+    stateNode &root = nodes[0];
+    int cut = 0;
+    for (int nodeId = 1; nodeId <= rootMoveCount; nodeId++)
+    {
+        stateNode &move = nodes[nodeId];
+        // The opponent picks the lowest reply, so the move's score can only go down from here
+        if (!move.isFinal && !move.isCut && move.bestScore <= root.bestScore)
+        {
+            move.isCut = true;
+            root.pendingChildren--;
+            cut++;
+        }
+    }
+    root.isFinal = root.pendingChildren == 0;
+    return cut;
+}
+
+vector<gameMove> nodeLine(const vector<stateNode> &nodes, int nodeId)
+{
+    vector<gameMove> line;
+    while (true)
+    {
+        line.push_back(nodes[nodeId].generatingMove);
+        if (nodes[nodeId].bestChild < 0) break;
+        nodeId = nodes[nodeId].bestChild;
+    }
+    // The rest comes from the slave that searched the job
+    line.insert(line.end(), nodes[nodeId].pv.begin(), nodes[nodeId].pv.end());
+    return line;
+}
 
+double estimateCost(const piece *state, bool maxTurn, int depthLeft)
+{
+    if (depthLeft <= 0) return 1;
 
-    cout << "Root moves: " << endl;
-    for (valueMove mv : rootOrderedMoves)
+    piece me = maxTurn ? BRD_MAX_DISC : BRD_MIN_DISC;
+    vector<gameMove> moves;
+    _kernels.getMoves(state, me, moves);
+    if (moves.size() == 0)
     {
-        cout << (char)(mv.move.x + 'a') << mv.move.y + 1 << " with a score of " << mv.value << endl;
+        // The opponent moves instead, without using up depth - or the game is over
+        _kernels.getMoves(state, -me, moves);
+        return moves.size() == 0 ? 1 : estimateCost(state, !maxTurn, depthLeft);
     }
+    if (depthLeft == 1) return moves.size();
+
+    // The children are made in one scratch board
+    int squares = _M * _N;
+    vector<piece> child(squares);
+    vector<gameMove> replies;
+    double grandChildren = 0;
+    for (gameMove mv : moves)
+    {
+        memcpy(&child.front(), state, squares);
+        _kernels.applyMove(&child.front(), mv.y, mv.x, me);
+        replies.clear();
+        _kernels.getMoves(&child.front(), -me, replies);
+        grandChildren += max((size_t)1, replies.size());
+    }
+
+    // Pruning leaves roughly the square root of the branching factor
+    double branching = _parameters.usePruning ? sqrt(AVG_BRANCH_FACTOR) : AVG_BRANCH_FACTOR;
+    return grandChildren * pow(branching, depthLeft - 2);
 }
 
-void generateNodes(board initState, int minJobs, vector<stateNode> &nodes, queue<int> &frontier)
+void generateNodes(const board &initState, int minJobs, nodeArena &arena, queue<int> &frontier)
 {
-    nodes.empty();
-    frontier.empty();
+    vector<stateNode> &nodes = arena.nodes;
+    int maxJobs = minJobs * JOB_MAX_COUNT_FACTOR;
+    double maxShare = _parameters.maxJobShare > 0 ? _parameters.maxJobShare : 1.0 / max(1, minJobs);
+
+    // Splitting a leaf adds about AVG_BRANCH_FACTOR nodes for AVG_BRANCH_FACTOR - 1 more leaves
+    size_t expectedNodes = (size_t)maxJobs * AVG_BRANCH_FACTOR / (AVG_BRANCH_FACTOR - 1) + AVG_BRANCH_FACTOR;
+    arena.squares = _M * _N;
+    nodes.clear();
+    nodes.reserve(expectedNodes);
+    arena.boards.clear();
+    arena.boards.reserve(expectedNodes * arena.squares);
+    frontier = queue<int>();
 
     stateNode root;
-    root.state = initState;
     root.parentIndex = -1;
     root.bestScore = INT_MIN;
     root.generatingMove = {-1, -1};
     root.isMaxNode = true;
+    root.bestChild = -1;
+    root.depth = 0;
+    root.cost = estimateCost(&initState.front(), true, _parameters.maxDepth);
+    root.pendingChildren = 0;
+    root.rootMove = -1;
+    root.isFinal = false;
+    root.isCut = false;
 
     nodes.push_back(root);
-    frontier.push(nodes.size() - 1);
-
-    bool noMovesForPrevNode = false;
-    int firstWithNoMoves = -1;
-    while (frontier.size() < minJobs)
+    arena.boards.insert(arena.boards.end(), initState.begin(), initState.end());
+
+    // The leaves of the tree so far, the most expensive on top
+    auto cheaper = [&nodes](int left, int right) { return nodes[left].cost < nodes[right].cost; };
+    priority_queue<int, vector<int>, decltype(cheaper)> leaves(cheaper);
+    vector<int> finalLeaves; // Leaves that can't be split
+    leaves.push(0);
+    double totalCost = root.cost;
+    vector<gameMove> nextMoves;
+
+    // Split the most expensive leaf until there are enough jobs and none of them is too large a share of the work
+    while (leaves.size() > 0 && (int)(leaves.size() + finalLeaves.size()) < maxJobs)
     {
-        int currentIdx = frontier.front();
-        vector<gameMove> nextMoves = getMoves(nodes[currentIdx].state, nodes[currentIdx].isMaxNode);
-        if (nextMoves.size() == 0)
+        int heaviest = leaves.top();
+        // The root is always split, the scores of its moves are put together from the jobs
+        if (heaviest != 0 && (int)(leaves.size() + finalLeaves.size()) >= minJobs && nodes[heaviest].cost <= maxShare * totalCost)
+            break;
+        leaves.pop();
+
+        bool isMaxNode = nodes[heaviest].isMaxNode;
+        piece me = isMaxNode ? BRD_MAX_DISC : BRD_MIN_DISC;
+        nextMoves.clear();
+        _kernels.getMoves(nodeBoard(arena, heaviest), me, nextMoves);
+        if (nextMoves.size() == 0 || (heaviest != 0 && _parameters.maxDepth - nodes[heaviest].depth <= JOB_MIN_DEPTH_LEFT))
         {
-            if (!noMovesForPrevNode)
-            {
-                noMovesForPrevNode = true;
-                firstWithNoMoves = currentIdx;
-                // Put this node at the back of the queue
-                frontier.pop();
-                frontier.push(currentIdx);
-            }
-            else if (firstWithNoMoves == currentIdx)
-            {
-                break; // None of the frontier nodes has children
-            }
-                
+            finalLeaves.push_back(heaviest);
+            continue;
         }
-        else
+
+        // Replace the leaf with its children - room for their boards is made first, so that the parent's stays put
+        totalCost -= nodes[heaviest].cost;
+        nodes[heaviest].pendingChildren = nextMoves.size();
+        int firstChild = nodes.size();
+        arena.boards.resize((firstChild + nextMoves.size()) * arena.squares);
+        for (size_t i = 0; i < nextMoves.size(); i++)
         {
-            // Remove the current index and place its children in the queue
-            frontier.pop();
-            for (gameMove mv : nextMoves)
-            {
-                stateNode newNode;
-                newNode.state = applyMove(nodes[currentIdx].state, mv, nodes[currentIdx].isMaxNode);
-                newNode.parentIndex = currentIdx;
-                newNode.generatingMove = mv;
-                newNode.isMaxNode = !nodes[currentIdx].isMaxNode;
-                newNode.bestScore = newNode.isMaxNode ? INT_MIN : INT_MAX;
-
-                nodes.push_back(newNode);
-                frontier.push(nodes.size() - 1);
-                
-            }
+            int childId = firstChild + i;
+            piece *state = nodeBoard(arena, childId);
+            memcpy(state, nodeBoard(arena, heaviest), arena.squares);
+            _kernels.applyMove(state, nextMoves[i].y, nextMoves[i].x, me);
+
+            stateNode newNode;
+            newNode.parentIndex = heaviest;
+            newNode.generatingMove = nextMoves[i];
+            newNode.isMaxNode = !isMaxNode;
+            newNode.bestScore = newNode.isMaxNode ? INT_MIN : INT_MAX;
+            newNode.bestChild = -1;
+            newNode.depth = nodes[heaviest].depth + 1;
+            newNode.cost = estimateCost(state, newNode.isMaxNode, _parameters.maxDepth - newNode.depth);
+            newNode.pendingChildren = 0;
+            newNode.rootMove = heaviest == 0 ? childId : nodes[heaviest].rootMove;
+            newNode.isFinal = false;
+            newNode.isCut = false;
+            totalCost += newNode.cost;
+
+            nodes.push_back(newNode);
+            leaves.push(childId);
         }
     }
+
+    // Every leaf becomes a job, the largest ones are handed out first
+    vector<int> jobs = finalLeaves;
+    for (; leaves.size() > 0; leaves.pop())
+        jobs.push_back(leaves.top());
+    stable_sort(jobs.begin(), jobs.end(), [&nodes](int left, int right) { return nodes[left].cost > nodes[right].cost; });
+    for (int nodeId : jobs)
+        frontier.push(nodeId);
+}
+
+// Size of a packed job message, the same on both sides
+static int jobMessageBytes()
+{
+    int headerBytes, boardBytes;
+    MPI_Pack_size(JOB_HEADER_INTS, MPI_INT, MPI_COMM_WORLD, &headerBytes);
+    MPI_Pack_size(_M * _N, MPI_CHAR, MPI_COMM_WORLD, &boardBytes);
+    return headerBytes + boardBytes;
 }
 
-long long sendJob(stateNode node, int jobId, int slaveId, int nodeDepth)
+long long sendJob(const nodeArena &arena, int nodeId, int slaveId, int maxBoards)
 {
+    TRACE_SCOPE(TRACE_COMM);
     timePoint before, after;
     before = timeNow();
     long long totalTime = 0;
@@ -243,20 +589,17 @@ long long sendJob(stateNode node, int jobId, int slaveId, int nodeDepth)
     short workFlag = FLAG_MORE_JOBS_TRUE;
     MPI_Send(&workFlag, 1, MPI_SHORT, slaveId, Tags::MORE_JOBS, MPI_COMM_WORLD);
 
-    // Send job ID
-    int jIdCopy = jobId;
-    MPI_Send(&jIdCopy, 1, MPI_INT, slaveId, Tags::SEARCH_JOB, MPI_COMM_WORLD);
+    // Pack the job ID, the MAX turn flag, the depth and the board budget, then the board from the arena
+    const stateNode &node = arena.nodes[nodeId];
+    int header[JOB_HEADER_INTS] = { nodeId, (int)node.isMaxNode, node.depth, maxBoards };
+    static vector<char> buffer;
+    int bufferBytes = jobMessageBytes();
+    buffer.resize(bufferBytes);
+    int position = 0;
+    MPI_Pack(header, JOB_HEADER_INTS, MPI_INT, &buffer.front(), bufferBytes, &position, MPI_COMM_WORLD);
+    MPI_Pack(nodeBoard(arena, nodeId), arena.squares, MPI_CHAR, &buffer.front(), bufferBytes, &position, MPI_COMM_WORLD);
+    MPI_Send(&buffer.front(), position, MPI_PACKED, slaveId, Tags::SEARCH_JOB, MPI_COMM_WORLD);
 
-    // Send the board to the slave
-    MPI_Send(&node.state.front(), _N * _M, MPI_CHAR, slaveId, Tags::SEARCH_JOB, MPI_COMM_WORLD);
-
-    // Send the MAX turn flag
-    int flag = (int)node.isMaxNode;
-    MPI_Send(&flag, 1, MPI_INT, slaveId, Tags::SEARCH_JOB, MPI_COMM_WORLD);
-
-    // Send the depth
-    MPI_Send(&nodeDepth, 1, MPI_INT, slaveId, Tags::SEARCH_JOB, MPI_COMM_WORLD);
-    
     // Time
     after = timeNow();
     totalTime += nsBetween(before, after);
@@ -266,10 +609,11 @@ long long sendJob(stateNode node, int jobId, int slaveId, int nodeDepth)
 
 jobResult receiveResult(int &slaveId)
 {
+    TRACE_SCOPE(TRACE_COMM);
     MPI_Status status;
     // Receive from any sender
-    int resArray[2];
-    MPI_Recv(resArray, 2, MPI_INT, MPI_ANY_SOURCE, Tags::SEARCH_JOB_RESULT, MPI_COMM_WORLD, &status);
+    int resArray[JOB_RESULT_MAX_INTS];
+    MPI_Recv(resArray, JOB_RESULT_MAX_INTS, MPI_INT, MPI_ANY_SOURCE, Tags::SEARCH_JOB_RESULT, MPI_COMM_WORLD, &status);
 
     // Query the status for the sender ID
     slaveId = status.MPI_SOURCE;
@@ -277,6 +621,9 @@ jobResult receiveResult(int &slaveId)
     jobResult res;
     res.jobId = resArray[0];
     res.score = resArray[1];
+    res.stopped = resArray[2] != 0;
+    for (int i = 0; i < resArray[3]; i++)
+        res.pv.push_back({ resArray[4 + 2 * i], resArray[5 + 2 * i] });
 
     return res;
 }
@@ -287,11 +634,16 @@ jobResult receiveResult(int &slaveId)
 
 void slaveMain(int masterId, int slaveId)
 {
-    long long totalRecvTime = 0;
-    long long totalSendTime = 0;
+    // Times for the current job
+    long long idleTime = 0;
+    long long recvTime = 0;
+    long long sendTime = 0;
     long long jobTime = 0;
     timePoint before, after;
 
+    // The master can stop jobs that no longer matter
+    _searchContext.pollMessages = stopMessageArrived;
+
     while (true)
     {
         // Will I be receiving a job?
@@ -299,7 +651,7 @@ void slaveMain(int masterId, int slaveId)
         timePoint beforeRecv = timeNow();
         MPI_Recv(&willGetJob, 1, MPI_SHORT, masterId, Tags::MORE_JOBS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
         timePoint afterRecv = timeNow();
-        totalRecvTime += nsBetween(beforeRecv, afterRecv);
+        idleTime = nsBetween(beforeRecv, afterRecv);
 
         // If not, send stats and I am done
         if (willGetJob == FLAG_MORE_JOBS_FALSE)
@@ -309,7 +661,8 @@ void slaveMain(int masterId, int slaveId)
 
         // Else, receive job
         searchJob currentJob;
-        totalRecvTime += receiveJob(currentJob, masterId);
+        recvTime = receiveJob(currentJob, masterId);
+        _runningJobId = currentJob.id;
         // cout << "Slave " << slaveId << " got job " << currentJob.id << " to evaluate for MAX: " << currentJob.isMaxTurn << " with board " << endl
         //      << printBoard(currentJob.state, _parameters.black) << endl;
 
@@ -323,41 +676,54 @@ void slaveMain(int masterId, int slaveId)
         before = timeNow();
         sendResult(result, masterId);
         after = timeNow();
-        totalSendTime += nsBetween(before, after);
+        sendTime = nsBetween(before, after);
 
         // Send stats
         slaveStats stats;
-        stats.sendTime = totalSendTime;
-        stats.receiveTime = totalRecvTime;
+        stats.sendTime = sendTime;
+        stats.receiveTime = recvTime;
         stats.jobTime = jobTime;
-        stats.boardsEvaluated = _boardsEvaluated;
-        stats.nodesPruned = _nodesPruned;
-        stats.estMaxDepthPruned = _estMaxDepthPruned;
-        stats.maxDepthReached = _maxDepthReached;
-        stats.entireSpace = _entireSpaceCovered;
+        stats.idleTime = idleTime;
+        stats.boardsEvaluated = _searchContext.stats.boardsEvaluated;
+        stats.nodesPruned = _searchContext.stats.nodesPruned;
+        stats.estMaxDepthPruned = _searchContext.stats.estMaxDepthPruned;
+        stats.maxDepthReached = _searchContext.stats.maxDepthReached;
+        stats.entireSpace = _searchContext.stats.entireSpaceCovered;
+        stats.remoteProbes = _searchContext.stats.remoteProbes;
+        stats.remoteHits = _searchContext.stats.remoteHits;
+        stats.remoteStores = _searchContext.stats.remoteStores;
+        stats.remoteProbeNs = _searchContext.stats.remoteProbeNs;
         MPI_Send(&stats, sizeof(stats), MPI_CHAR, masterId, Tags::SEARCH_JOB_STATS, MPI_COMM_WORLD);
     }
+
+    // Stop messages that came too late for their job are sent before the dismissal, so they are here by now
+    _runningJobId = -1;
+    stopMessageArrived();
+    _searchContext.pollMessages = nullptr;
 }
 
 long long receiveJob(searchJob &job, int masterId)
 {
+    TRACE_SCOPE(TRACE_COMM);
     timePoint recvStart = timeNow();
-    // Get the job ID
-    MPI_Recv(&job.id, 1, MPI_INT, masterId, Tags::SEARCH_JOB, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-    // Make a new board
+    // Get the packed job
+    static vector<char> buffer;
+    int bufferBytes = jobMessageBytes();
+    buffer.resize(bufferBytes);
+    MPI_Recv(&buffer.front(), bufferBytes, MPI_PACKED, masterId, Tags::SEARCH_JOB, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+    // The job ID, the MAX turn flag, the node depth and the board budget
+    int header[JOB_HEADER_INTS];
+    int position = 0;
+    MPI_Unpack(&buffer.front(), bufferBytes, &position, header, JOB_HEADER_INTS, MPI_INT, MPI_COMM_WORLD);
+    job.id = header[0];
+    job.isMaxTurn = (bool)header[1];
+    job.depth = header[2];
+    job.maxBoards = header[3];
+
+    // Then the board
     job.state = board(_M * _N);
-
-    // Get the board
-    MPI_Recv(&job.state.front(), _N * _M, MPI_CHAR, masterId, Tags::SEARCH_JOB, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-    // Receive the MAX turn flag
-    int flag;
-    MPI_Recv(&flag, 1, MPI_INT, masterId, Tags::SEARCH_JOB, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    job.isMaxTurn = (bool)flag;
-
-    // Receive the node depth
-    MPI_Recv(&job.depth, 1, MPI_INT, masterId, Tags::SEARCH_JOB, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    MPI_Unpack(&buffer.front(), bufferBytes, &position, &job.state.front(), _M * _N, MPI_CHAR, MPI_COMM_WORLD);
 
     // Time
     timePoint recvEnd = timeNow();
@@ -368,19 +734,44 @@ jobResult doJob(searchJob job)
 {
     jobResult result;
     result.jobId = job.id;
-    result.score = slaveSearch(job.state, _parameters.maxDepth, job.isMaxTurn, job.depth);
+    result.score = slaveSearch(job.state, _parameters.maxDepth, job.isMaxTurn, job.depth, job.maxBoards, result.pv);
+    result.stopped = _searchContext.budget->stopped.load();
     return result;
 }
 
 void sendResult(jobResult result, int masterId)
 {
+    TRACE_SCOPE(TRACE_COMM);
     // Put contents in an array since we want them to be sent as one message
-    int resArray[2];
+    int resArray[JOB_RESULT_MAX_INTS];
+    int pvLength = min((int)result.pv.size(), PV_MAX_PLY);
     resArray[0] = result.jobId;
     resArray[1] = result.score;
+    resArray[2] = (int)result.stopped;
+    resArray[3] = pvLength;
+    for (int i = 0; i < pvLength; i++)
+    {
+        resArray[4 + 2 * i] = result.pv[i].x;
+        resArray[5 + 2 * i] = result.pv[i].y;
+    }
 
     // Send the array
-    MPI_Send(resArray, 2, MPI_INT, masterId, Tags::SEARCH_JOB_RESULT, MPI_COMM_WORLD);
+    MPI_Send(resArray, 4 + 2 * pvLength, MPI_INT, masterId, Tags::SEARCH_JOB_RESULT, MPI_COMM_WORLD);
+}
+
+bool stopMessageArrived()
+{
+    bool stop = false;
+    int waiting = 0;
+    MPI_Iprobe(MASTER_ID, Tags::STOP_JOB, MPI_COMM_WORLD, &waiting, MPI_STATUS_IGNORE);
+    while (waiting)
+    {
+        int jobId;
+        MPI_Recv(&jobId, 1, MPI_INT, MASTER_ID, Tags::STOP_JOB, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        stop = stop || jobId == _runningJobId;
+        MPI_Iprobe(MASTER_ID, Tags::STOP_JOB, MPI_COMM_WORLD, &waiting, MPI_STATUS_IGNORE);
+    }
+    return stop;
 }
 
 void slaveBoardEval()
@@ -3,12 +3,24 @@
 #include "general.h"
 #include "board.h"
 #include "stats.h"
+#include "search.h"
 
 #include <iostream>
 
 #define FLAG_MORE_JOBS_TRUE 1
 #define FLAG_MORE_JOBS_FALSE 0
 
+#define JOB_MAX_COUNT_FACTOR 8	// The job generator makes at most this many times the minimum number of jobs
+#define JOB_MIN_DEPTH_LEFT 1	// Nodes with this much depth left or less are not split into smaller jobs
+
+// Fault tolerance
+#define RESULT_POLL_US 100			// How long the master sleeps between checks for results
+#define RESULT_GRACE_SECONDS 0.25	// Results are waited for until this long after the search deadline, then the finished jobs give the answer
+#define RESULT_DRAIN_MIN_SECONDS 0.1	// The slaves still searching at the end get until the end of the timeout to stop and answer, but at least this long -
+#define RESULT_DRAIN_MAX_SECONDS 5.0	// ... and no more than this, for searches without a timeout. One that doesn't answer is hung, and the run is aborted.
+#define STRAGGLER_FACTOR 3.0		// A job running this many times longer than expected for its cost is copied to an idle slave
+#define STRAGGLER_MIN_SECONDS 0.05	// ... but only once it has run for at least this long
+
 // The slaves are processes 0 to (N-2) and process (N-1) is the master
 #define MASTER_ID _slaveCount
 
@@ -18,21 +30,52 @@ enum Tags
     SEARCH_JOB,
     SEARCH_JOB_RESULT,
     SEARCH_JOB_STATS,
+    STOP_JOB,
     STATIC_EVAL_MORE_WORK,
     STATIC_EVAL_DATA,
     STATIC_EVAL_RESULT
 };
 
 
+// A node of the tree the master splits the search into - its board is kept in the arena
 struct stateNode
 {
-    board state;
     int parentIndex;
     int bestScore;
     gameMove generatingMove; // What move led to this state
     bool isMaxNode;
+    int bestChild; // Index of the child with the best score, -1 for the nodes sent as jobs
+    vector<gameMove> pv; // For the nodes sent as jobs - the expected line of play, as found by the slave
+    int depth; // Moves from the root
+    double cost; // Estimated number of boards the search of the node's subtree evaluates
+    int pendingChildren; // Children whose score is not final yet
+    int rootMove; // Index of the root move this node is under(itself for the root moves), -1 for the root
+    bool isFinal; // The score is final - the job's result arrived, or all of the children are final
+    bool isCut; // For root moves - shown not to beat the best root move, the jobs under it are cancelled
+};
+
+/*
+The master's nodes - the records in one vector, their boards packed one after another in another
+Nodes are referred to by index and never copied, jobs are packed for sending straight from the arena
+*/
+struct nodeArena
+{
+    vector<stateNode> nodes;
+    vector<piece> boards; // The board of node i is at [i * squares, (i + 1) * squares)
+    int squares = 0;
 };
 
+// The board of the node at <nodeId> - only valid until nodes are added
+inline piece *nodeBoard(nodeArena &arena, int nodeId)
+{
+    return &arena.boards[(size_t)nodeId * arena.squares];
+}
+
+inline const piece *nodeBoard(const nodeArena &arena, int nodeId)
+{
+    return &arena.boards[(size_t)nodeId * arena.squares];
+}
+
 // Holds an instance of the initial information sent to a slave
 struct searchJob
 {
@@ -40,32 +83,72 @@ struct searchJob
     board state;
     bool isMaxTurn;
     int depth;
+    int maxBoards; // The job's share of the board budget
 };
 
 struct jobResult
 {
     int jobId;
     int score;
+    bool stopped; // The search was cut short by the deadline or a stop message - the score is not final
+    vector<gameMove> pv; // The expected line of play from the job's board
 };
 
+// Job ID, score, stopped flag, PV length and the PV moves as x, y pairs
+#define JOB_RESULT_MAX_INTS (4 + 2 * PV_MAX_PLY)
+// A job is sent as one packed message - job ID, MAX turn flag, node depth and board budget, then the board
+#define JOB_HEADER_INTS 4
+
 /*
 ********* MASTER FUNCTIONS *********
 */
 
-void masterMain(board initState, int slaveCount);
+/*
+Run a parallel search from <initState>, handing out jobs to <slaveCount> slaves
+writeReports - print the results and append the stats to the stats files
+*/
+searchSummary masterMain(board initState, int slaveCount, bool writeReports);
 
 /*
-BFS to generate nodes
-- The last <minJobs> nodes go into the frontier - they will be turned into jobs and sent to slaves
-*/ 
-void generateNodes(board initState, int minJobs, vector<stateNode> &nodes, queue<int>&frontier);
+Estimate how many boards a search of <depthLeft> plies from <state> evaluates
+Counts the positions two plies down and grows that by the effective branching factor for the rest of the depth
+*/
+double estimateCost(const piece *state, bool maxTurn, int depthLeft);
 
-// Send a job to process <slaveId>
-long long sendJob(stateNode job, int jobId, int slaveId, int nodeDepth);
+/*
+Generate the nodes to be searched as jobs
+- Keeps splitting the leaf with the largest estimated cost until there are at least <minJobs> leaves and none of
+  them is more than MaxJobShare of the total estimated cost(by default 1 / <minJobs>), up to JOB_MAX_COUNT_FACTOR * <minJobs> leaves
+- The leaves go into the frontier, most expensive first - they will be turned into jobs and sent to slaves
+- The nodes are made in <arena>, the root is node 0
+*/
+void generateNodes(const board &initState, int minJobs, nodeArena &arena, queue<int> &frontier);
+
+/*
+The score of the node at <nodeId> is final - pass it up to its parent, and on up through the ancestors it makes final
+Results for nodes under a cut root move are ignored
+*/
+void propagateResult(vector<stateNode> &nodes, int nodeId);
+
+/*
+Cut the root moves whose score so far(the lowest of their final replies) already can't beat the best final root move
+Their remaining jobs are cancelled, and they only get an upper bound for a score. Returns how many moves were cut.
+*/
+int cutRootMoves(vector<stateNode> &nodes, int rootMoveCount);
+
+/*
+The expected line of play from the node at <nodeId>, once the scores have been propagated
+Follows the best children down to a job, then appends the line the slave found for it
+*/
+vector<gameMove> nodeLine(const vector<stateNode> &nodes, int nodeId);
+
+// Send the node at <nodeId> as a job to process <slaveId>, which may evaluate up to <maxBoards> boards for it
+long long sendJob(const nodeArena &arena, int nodeId, int slaveId, int maxBoards);
 
 /*
 - Receive job results from a slave
 - Store the ID of the slave that we received from in slaveId
+- A stopped job's score is not final - it is neither propagated nor used to cut root moves
 */
 jobResult receiveResult(int &slaveId);
 
@@ -88,4 +171,10 @@ jobResult doJob(searchJob job);
 // Send results back
 void sendResult(jobResult result, int masterId);
 
+/*
+Has the master told this slave to stop its job? Stop messages for the slave's earlier jobs are taken off the queue and ignored.
+The stopped job's result is sent back as usual, flagged as stopped so that the master disregards its score.
+*/
+bool stopMessageArrived();
+
 
@@ -1,103 +1,316 @@
 #include "stdafx.h"
 #include "search.h"
-
-#define MOVE_ORDER_SEARCH_DEPTH 2
+#include "threadpool.h"
 
 // The parameters for searching
 evalParams _parameters;
 
-// How many boards have we evaluated in total
-int _boardsEvaluated = 0;
-// The maximum depth we reached
-int _maxDepthReached = 0;
-// Have we looked through the entire search space
-bool _entireSpaceCovered = true;
-// How many nodes we pruned
-int _nodesPruned = 0;
-// Estimate of the nodes at maxDepth that were pruned
-int _estMaxDepthPruned = 0;
+// Count an evaluated board, publishing the count to the other threads in batches
+inline void countBoard(searchContext &ctx)
+{
+	ctx.stats.boardsEvaluated++;
+	if (++ctx.stats.unflushedBoards >= BUDGET_FLUSH_BATCH)
+		flushBoards(ctx);
+}
+
+// Would evaluating <boards> more boards go over the budget? Batching makes this approximate across threads
+inline bool overBudget(const searchContext &ctx, int boards)
+{
+	return ctx.budget->used.load(memory_order_relaxed) + ctx.stats.unflushedBoards + boards > ctx.budget->limit;
+}
+
+// Check the clock and for stop messages, stopping the search - and its other threads - if either says so
+void checkStop(searchContext &ctx, timePoint now)
+{
+	if (now > ctx.deadline || (ctx.pollMessages != nullptr && ctx.pollMessages()))
+		ctx.budget->stopped.store(true, memory_order_relaxed);
+}
+
+// Check for a stop, and count down to the next check from the node rate since this one - the next check falls
+// STOP_POLL_SECONDS from now, or just after the deadline if that is sooner
+void pollStop(searchContext &ctx)
+{
+	timePoint now = timeNow();
+	checkStop(ctx, now);
+
+	double seconds = nsBetween(ctx.lastPoll, now) / BLN_DOUBLE;
+	double nodesPerSecond = seconds > 0 ? ctx.pollInterval / seconds : STOP_POLL_MAX_NODES / STOP_POLL_SECONDS;
+	double nodes = nodesPerSecond * STOP_POLL_SECONDS;
+	if (ctx.deadline != timePoint::max())
+		nodes = min(nodes, nodesPerSecond * nsBetween(now, ctx.deadline) / BLN_DOUBLE + 1);
+	ctx.pollInterval = (int)max((double)STOP_POLL_MIN_NODES, min((double)STOP_POLL_MAX_NODES, nodes));
+	ctx.pollCountdown = ctx.pollInterval;
+	ctx.lastPoll = now;
+}
+
+// Has the search been stopped? Only the flag is read at every node, the clock and the messages every so many nodes
+inline bool searchStopped(searchContext &ctx)
+{
+	if (--ctx.pollCountdown <= 0)
+		pollStop(ctx);
+	return ctx.budget->stopped.load(memory_order_relaxed);
+}
+
+// Boards split between the processes for evaluation can only be searched by one thread - with fewer than
+// two slaves, static evaluation is done in the searching thread and the root can be split as usual
+inline bool canSplitRoot(const evalParams &params)
+{
+	return params.threads != 1 && !(params.useStaticEvaluation && !params.parallelSearch && _slaveCount >= 2);
+}
+
+int negaMax(searchContext &ctx, const board &state, short depth, short alpha, short beta, bool maxTurn, bool isProbe, short ply = 0);
+
+vector<gameMove> principalVariation(const searchContext &ctx, short ply)
+{
+	if (ply >= PV_MAX_PLY) return vector<gameMove>();
+	return vector<gameMove>(ctx.pv.moves[ply], ctx.pv.moves[ply] + ctx.pv.length[ply]);
+}
+
+// <move> is the best so far at <ply> - its line is the move, then the line from the next ply
+void updatePV(searchContext &ctx, short ply, const gameMove &move)
+{
+	if (ply >= PV_MAX_PLY) return;
+
+	pvTable &pv = ctx.pv;
+	int childLength = ply + 1 < PV_MAX_PLY ? min(pv.length[ply + 1], PV_MAX_PLY - 1) : 0;
+	pv.moves[ply][0] = move;
+	for (int i = 0; i < childLength; i++)
+		pv.moves[ply][i + 1] = pv.moves[ply + 1][i];
+	pv.length[ply] = childLength + 1;
+}
+
+// Clamp a score to the range of the search window
+short windowScore(float score)
+{
+	return (short)max((float)SHRT_MIN + 2, min((float)SHRT_MAX - 2, roundf(score)));
+}
+
+/*
+Try to cut a node without searching its children
+Returns true if the node can be cut, with the value to return in <cutoff>
+*/
+bool forwardPrune(searchContext &ctx, const board &state, short depth, short alpha, short beta, bool maxTurn, bool isProbe, int &cutoff)
+{
+	// Stability cutoff - even winning every square that is not a stable opponent disc won't beat alpha
+	if (ctx.params.useStabilityCutoff)
+	{
+		int bound = stabilityBound(ctx, state, maxTurn);
+		if (bound <= alpha)
+		{
+			cutoff = bound;
+			return true;
+		}
+	}
+
+	// ProbCut - if shallow searches predict with enough confidence that the deep one will fall outside
+	// the window, skip it. Checks are not made inside the shallow searches themselves
+	if (isProbe || depth >= PROBCUT_MAX_DEPTH) return false;
+	for (int c = 0; c < ctx.params.probCutCount[depth]; c++)
+	{
+		const probCutCheck &check = ctx.params.probCut[depth][c];
+		float margin = ctx.params.probCutThreshold * check.sigma;
+
+		// The shallow score above which the deep one is likely to be >= beta
+		if (beta < SHRT_MAX - 1)
+		{
+			short bound = windowScore((beta + margin - check.b) / check.a);
+			if (negaMax(ctx, state, check.shallowDepth, bound - 1, bound, maxTurn, true) >= bound)
+			{
+				cutoff = beta;
+				return true;
+			}
+		}
+
+		// The shallow score below which the deep one is likely to be <= alpha
+		if (alpha > SHRT_MIN + 1)
+		{
+			short bound = windowScore((alpha - margin - check.b) / check.a);
+			if (negaMax(ctx, state, check.shallowDepth, bound, bound + 1, maxTurn, true) <= bound)
+			{
+				cutoff = alpha;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// Look <key> up in the table shared by the slaves, keeping the entry in the process' table if it is found
+bool probeShared(searchContext &ctx, unsigned long long key, hashEntry &info)
+{
+	timePoint before = timeNow();
+	bool found = probeDistributed(*ctx.sharedTable, key, info);
+	ctx.stats.remoteProbeNs += nsBetween(before, timeNow());
+	ctx.stats.remoteProbes++;
+	if (found)
+	{
+		ctx.stats.remoteHits++;
+		if (ctx.table != nullptr) storeTable(*ctx.table, key, info);
+	}
+	return found;
+}
 
-int negaMax(const board &state, short depth, short alpha, short beta, bool maxTurn, bool isProbe)
+// Keep the result of a node for later searches - unless it was cut short by the timeout or the board budget
+void storeNode(searchContext &ctx, unsigned long long key, short depth, int value, short alpha, short beta, const gameMove &bestMove, bool shared)
 {
-	// LOG_DEBUG("Negamax, MAX: " << maxTurn << " probe: " << isProbe << " depth: " << depth << " alpha: " << alpha << " beta: " << beta << " board: " << endl << printBoard(state, _parameters.black));
+	if (overBudget(ctx, 0) || ctx.budget->stopped.load(memory_order_relaxed)) return;
+
+	hashEntry info;
+	info.score = value;
+	info.depth = depth;
+	info.bestMove = bestMove;
+	if (!ctx.params.usePruning || (value > alpha && value < beta))
+		info.bound = HASH_EXACT;
+	else
+		info.bound = value <= alpha ? HASH_UPPER_BOUND : HASH_LOWER_BOUND;
+	if (ctx.table != nullptr) storeTable(*ctx.table, key, info);
+	if (shared)
+	{
+		storeDistributed(*ctx.sharedTable, key, info);
+		ctx.stats.remoteStores++;
+	}
+}
+
+int negaMax(searchContext &ctx, const board &state, short depth, short alpha, short beta, bool maxTurn, bool isProbe, short ply)
+{
+	// LOG_DEBUG("Negamax, MAX: " << maxTurn << " probe: " << isProbe << " depth: " << depth << " alpha: " << alpha << " beta: " << beta << " board: " << endl << printBoard(state, ctx.params.black));
 
 	short multiplier = maxTurn ? 1 : -1; // When we evaluate a node for MIN, we want to return <-score>
 
-	if (!isProbe && _parameters.maxDepth - depth > _maxDepthReached)
-		_maxDepthReached = _parameters.maxDepth - depth;
+	if (!isProbe && ply < PV_MAX_PLY)
+		ctx.pv.length[ply] = 0;
+
+	if (!isProbe && ctx.params.maxDepth - depth > ctx.stats.maxDepthReached)
+		ctx.stats.maxDepthReached = ctx.params.maxDepth - depth;
 	
 	vector<gameMove> moves = getMoves(state, maxTurn);
 	vector<gameMove> opponentMoves = getMoves(state, !maxTurn);
 
-	if (depth <= 0 || secondsElapsed() > _parameters.timeout)
+	if (depth <= 0 || searchStopped(ctx))
 	{
 		// if(!isProbe) LOG_DEBUG("DEPTH is " << depth << " or out of time");
 		
-		if(!isProbe) _boardsEvaluated++;
+		if(!isProbe) countBoard(ctx);
 		// If we have more moves but we have to stop, we haven't checked everything
 		if(!isProbe && (getMoves(state, true).size() > 0 || getMoves(state,false).size() > 0))
-			_entireSpaceCovered = false;
+			ctx.stats.entireSpaceCovered = false;
 		// Always evaluate for MAX!
-		return evalBoard(state, moves.size() == 0 && opponentMoves.size() == 0, 
+		return evalBoard(ctx, state, moves.size() == 0 && opponentMoves.size() == 0, 
 				maxTurn ? moves.size() : opponentMoves.size(), maxTurn ? opponentMoves.size() : moves.size()) * multiplier;
 	}
 
-	if (!isProbe && _parameters.useMoveOrdering)
-	{
-		moves = treeSearch(state, MOVE_ORDER_SEARCH_DEPTH, true, maxTurn);
-	}
-
 	// If no moves - evaluate board
 	if (moves.size() == 0)
 	{
 		if (opponentMoves.size() == 0)
 		{
-			// LOG_DEBUG(" No more moves for MIN, board: " << endl << printBoard(state, _parameters.black));
-			if(!isProbe) _boardsEvaluated++;
-			return evalBoard(state, true, maxTurn ? moves.size() : opponentMoves.size(), maxTurn ? opponentMoves.size() : moves.size()) * multiplier;
+			// LOG_DEBUG(" No more moves for MIN, board: " << endl << printBoard(state, ctx.params.black));
+			if(!isProbe) countBoard(ctx);
+			return evalBoard(ctx, state, true, maxTurn ? moves.size() : opponentMoves.size(), maxTurn ? opponentMoves.size() : moves.size()) * multiplier;
 		}
 		else
 		{
-			return -negaMax(state, depth, -beta, -alpha, !maxTurn, isProbe);
+			int value = -negaMax(ctx, state, depth, -beta, -alpha, !maxTurn, isProbe, ply + 1);
+			if (!isProbe) updatePV(ctx, ply, PASS_MOVE);
+			return value;
+		}
+	}
+
+	// Look the node up in the transposition table - a deep enough result may settle it, otherwise its best move is tried first
+	// Nodes far enough from the leaves to be worth a round trip are also looked up in the table shared by the slaves
+	bool useShared = ctx.sharedTable != nullptr && !isProbe && depth >= ctx.params.sharedHashDepth;
+	bool useTable = (ctx.table != nullptr || useShared) && !isProbe && depth >= HASH_MIN_DEPTH;
+	unsigned long long hashKey = 0;
+	gameMove hashMove = PASS_MOVE;
+	short alphaIn = alpha;
+	if (useTable)
+	{
+		hashKey = hashBoard(state, maxTurn);
+		hashEntry cached;
+		if ((ctx.table != nullptr && probeTable(*ctx.table, hashKey, cached)) || (useShared && probeShared(ctx, hashKey, cached)))
+		{
+			if (cached.depth >= depth && (cached.bound == HASH_EXACT || (cached.bound == HASH_LOWER_BOUND && cached.score >= beta)
+										  || (cached.bound == HASH_UPPER_BOUND && cached.score <= alpha)))
+			{
+				// The line below the node isn't kept in the table - it goes on with the stored best move and ends there
+				if (cached.bestMove.x >= 0)
+				{
+					if (ply + 1 < PV_MAX_PLY) ctx.pv.length[ply + 1] = 0;
+					updatePV(ctx, ply, cached.bestMove);
+				}
+				return cached.score;
+			}
+			hashMove = cached.bestMove;
 		}
 	}
 
 	// If we will run out of boards while evaluating the children of this node -
 	// return an esimated utility value for this node
-	if (_boardsEvaluated + moves.size() > _parameters.maxBoards)
+	if (overBudget(ctx, moves.size()))
+	{
+		if(!isProbe) countBoard(ctx);
+		ctx.stats.entireSpaceCovered = false;
+		return evalBoard(ctx, state, false, maxTurn ? moves.size() : opponentMoves.size(), maxTurn ? opponentMoves.size() : moves.size()) * multiplier;
+	}
+
+	if (ctx.params.usePruning)
+	{
+		int cutoff;
+		if (forwardPrune(ctx, state, depth, alpha, beta, maxTurn, isProbe, cutoff))
+		{
+			ctx.stats.nodesPruned += moves.size();
+			return cutoff;
+		}
+	}
+
+	if (!isProbe && ctx.params.useMoveOrdering)
+	{
+		moves = treeSearch(ctx, state, MOVE_ORDER_SEARCH_DEPTH, true, maxTurn);
+	}
+
+	if (hashMove.x >= 0)
 	{
-		if(!isProbe) _boardsEvaluated++;
-		_entireSpaceCovered = false;
-		return evalBoard(state, false, maxTurn ? moves.size() : opponentMoves.size(), maxTurn ? opponentMoves.size() : moves.size()) * multiplier;
+		auto found = find_if(moves.begin(), moves.end(), [&hashMove](const gameMove &mv) { return mv.x == hashMove.x && mv.y == hashMove.y; });
+		if (found != moves.end()) rotate(moves.begin(), found, found + 1);
 	}
 
 	int maxValue = INT_MIN + 1;
+	gameMove bestMove = PASS_MOVE;
 
 	for (auto it = moves.begin(); it != moves.end(); it++)
 	{
-		int value = -negaMax(applyMove(state, *(it), maxTurn), depth - 1, -beta, -alpha, !maxTurn, isProbe);
+		int value = -negaMax(ctx, applyMove(state, *(it), maxTurn), depth - 1, -beta, -alpha, !maxTurn, isProbe, ply + 1);
 
-		if (value > maxValue) maxValue = value;
+		if (value > maxValue)
+		{
+			maxValue = value;
+			bestMove = *it;
+			if (!isProbe) updatePV(ctx, ply, *it);
+		}
 
-		if (_parameters.usePruning && maxValue > alpha)
+		if (ctx.params.usePruning && maxValue > alpha)
 		{
 			alpha = maxValue;
 			if (maxValue >= beta)
 			{
-				_nodesPruned += moves.end() - it;
+				ctx.stats.nodesPruned += moves.end() - it;
 				// We've we're pruning the rest of the children
-				_estMaxDepthPruned += pow(AVG_BRANCH_FACTOR, depth - 1) * (moves.end() - it) - depth;
+				ctx.stats.estMaxDepthPruned += pow(AVG_BRANCH_FACTOR, depth - 1) * (moves.end() - it) - depth;
+				if (useTable) storeNode(ctx, hashKey, depth, maxValue, alphaIn, beta, bestMove, useShared);
 				return maxValue;
 			}
 		}
 	}
 
+	if (useTable) storeNode(ctx, hashKey, depth, maxValue, alphaIn, beta, bestMove, useShared);
 	return maxValue;
 }
 
 
-vector<gameMove> treeSearch(const board &state, short maxDepth, bool isProbe, bool isMaxTurn)
+vector<gameMove> treeSearch(searchContext &ctx, const board &state, short maxDepth, bool isProbe, bool isMaxTurn)
 {
+	if (!isProbe) useContextBoard(ctx);
 
 	// Get next moves
 	vector<gameMove> moves = getMoves(state, isMaxTurn);
@@ -111,37 +324,57 @@ vector<gameMove> treeSearch(const board &state, short maxDepth, bool isProbe, bo
 	if (!isProbe)
 	{
 		// Reset the number of evaluated boards
-		_boardsEvaluated = 0;
-		_maxDepthReached = 0;
-		_nodesPruned = 0;
-		_estMaxDepthPruned = 0;
-		_entireSpaceCovered = true;
+		startSearch(ctx, ctx.params.maxBoards);
 	}
 
 	short alpha = SHRT_MIN + 1;
 	short beta = SHRT_MAX - 1;
 
-	for (int i = 0; i < moves.size(); i++)
+	if (!isProbe && ctx.params.multiPV > 0)
 	{
-		orderedMoves[i].move = moves[i];
-		// ! Call with -beta, -alpha, since we update alpha
-		int val = (isMaxTurn ? -1 : 1) * negaMax(applyMove(state, moves[i], isMaxTurn), maxDepth - 1, -beta, -alpha, !isMaxTurn, isProbe);
-		orderedMoves[i].value = val;
-		
-		// if (val > alpha) alpha = val;
+		orderedMoves = multiPVSearch(ctx, state, maxDepth, ctx.params.multiPV, isMaxTurn);
+	}
+	else if (!isProbe && canSplitRoot(ctx.params))
+	{
+		orderedMoves = parallelRootSearch(ctx, state, maxDepth, ctx.params.threads, isMaxTurn);
+	}
+	else
+	{
+		for (int i = 0; i < moves.size(); i++)
+		{
+			orderedMoves[i].move = moves[i];
+			// ! Call with -beta, -alpha, since we update alpha
+			int val = (isMaxTurn ? -1 : 1) * negaMax(ctx, applyMove(state, moves[i], isMaxTurn), maxDepth - 1, -beta, -alpha, !isMaxTurn, isProbe, 1);
+			orderedMoves[i].value = val;
+			if (!isProbe)
+			{
+				updatePV(ctx, 0, moves[i]);
+				orderedMoves[i].pv = principalVariation(ctx, 0);
+			}
+			
+			// if (val > alpha) alpha = val;
+		}
+
+		sort(orderedMoves.begin(), orderedMoves.end(), [](const valueMove &left, const valueMove &right)
+		{
+			return left.value > right.value; // Sort in descending order
+		});
 	}
 
-	sort(orderedMoves.begin(), orderedMoves.end(), [](const valueMove &left, const valueMove &right)
+	if (!isProbe)
 	{
-		return left.value > right.value; // Sort in descending order
-	});
+		flushBoards(ctx);
+		ctx.rootMoves = orderedMoves;
+	}
 
-	if(!isProbe)
+	if(!isProbe && ctx.writeReports)
 	{
 		cout << "Moves: " << endl;
 		for (valueMove mv : orderedMoves)
 		{
-			cout << (char)(mv.move.x + 'a') << mv.move.y + 1 << " with a score of " << mv.value << endl;
+			cout << (char)(mv.move.x + 'a') << mv.move.y + 1 << " with a score of " << (mv.isExact ? "" : "at most ") << mv.value;
+			if (mv.pv.size() > 0) cout << ", line: " << lineString(mv.pv);
+			cout << endl;
 		}
 	}
 
@@ -153,26 +386,236 @@ vector<gameMove> treeSearch(const board &state, short maxDepth, bool isProbe, bo
 	return moves;
 }
 
-int slaveSearch(const board &state, short maxDepth, bool isMaxTurn, int currentDepth)
+vector<gameMove> treeSearch(const board &state, short maxDepth, bool isProbe, bool isMaxTurn)
+{
+	return treeSearch(isProbe ? _searchContext : loadGlobalContext(), state, maxDepth, isProbe, isMaxTurn);
+}
+
+// A root move, or a reply to one, searched as one task of a parallel root search
+struct rootTask
+{
+	int rootIndex;		// The root move this task scores
+	bool isReply;		// Does the task search one reply to the root move, or all of them
+	gameMove reply;
+	board state;		// The position after the move(and the reply)
+	int estimate;		// Estimated size of the subtree - the mobility of the side to move
+};
+
+// The score of a root move, put together from the tasks that search it
+struct rootScore
+{
+	int value = SHRT_MAX - 1;	// For the side to move at the root - the lowest score of the replies searched so far
+	bool isExact = true;		// False if <value> is only an upper bound
+	vector<gameMove> pv;
+	int pendingTasks = 0;
+};
+
+// Raise the shared alpha to <value>, if that is higher
+inline void raiseAlpha(atomic<int> &alpha, int value)
+{
+	int current = alpha.load();
+	while (value > current && !alpha.compare_exchange_weak(current, value));
+}
+
+vector<valueMove> parallelRootSearch(searchContext &ctx, const board &state, short maxDepth, int threadCount, bool isMaxTurn)
+{
+	threadPool &pool = searchPool(threadCount);
+	int workerCount = pool.workers.size();
+
+	vector<gameMove> moves = getMoves(state, isMaxTurn);
+	vector<rootScore> scores(moves.size());
+	vector<rootTask> tasks;
+
+	// With few root moves, hand out the replies to them instead, so that every worker gets several tasks
+	bool splitReplies = maxDepth >= 2 && moves.size() < (size_t)workerCount * ROOT_SPLIT_TASKS_PER_THREAD;
+	for (int i = 0; i < (int)moves.size(); i++)
+	{
+		board child = applyMove(state, moves[i], isMaxTurn);
+		vector<gameMove> replies = splitReplies ? getMoves(child, !isMaxTurn) : vector<gameMove>();
+		if (replies.size() == 0)
+		{
+			tasks.push_back({ i, false, PASS_MOVE, child, (int)getMoves(child, !isMaxTurn).size() });
+			continue;
+		}
+		for (gameMove reply : replies)
+		{
+			board grandChild = applyMove(child, reply, !isMaxTurn);
+			tasks.push_back({ i, true, reply, grandChild, (int)getMoves(grandChild, isMaxTurn).size() });
+		}
+	}
+	for (rootTask &task : tasks)
+		scores[task.rootIndex].pendingTasks++;
+
+	// Largest first, so that the small tasks fill in the gaps at the end
+	stable_sort(tasks.begin(), tasks.end(), [](const rootTask &left, const rootTask &right)
+	{
+		return left.estimate > right.estimate;
+	});
+
+	const short beta = SHRT_MAX - 1;
+	const int noAlpha = SHRT_MIN + 1;
+	atomic<int> alpha(noAlpha); // The best exact root score so far - later tasks only need to show they can't beat it
+	mutex scoresLock;
+	taskGroup group;
+
+	for (size_t t = 0; t < tasks.size(); t++)
+	{
+		submitTask(pool, group, [&, t]
+		{
+			const rootTask &task = tasks[t];
+			unique_ptr<searchContext> taskCtx(new searchContext());
+			forkContext(*taskCtx, ctx);
+			useContextBoard(*taskCtx);
+
+			short taskAlpha = alpha.load();
+			int value;
+			bool searched = true; // False if the reply was skipped
+			short taskBeta = beta;
+			if (task.isReply)
+			{
+				{
+					lock_guard<mutex> guard(scoresLock);
+					taskBeta = scores[task.rootIndex].value; // The reply only matters if it is worse for us than the ones already searched
+				}
+				if (taskBeta <= taskAlpha) // Another reply already shows this move can't beat alpha
+				{
+					value = taskBeta;
+					searched = false;
+				}
+				else
+				{
+					value = negaMax(*taskCtx, task.state, maxDepth - 2, taskAlpha, taskBeta, isMaxTurn, false, 2);
+				}
+				updatePV(*taskCtx, 1, task.reply);
+			}
+			else
+			{
+				value = -negaMax(*taskCtx, task.state, maxDepth - 1, -beta, -taskAlpha, !isMaxTurn, false, 1);
+			}
+			updatePV(*taskCtx, 0, moves[task.rootIndex]);
+			flushBoards(*taskCtx);
+
+			lock_guard<mutex> guard(scoresLock);
+			mergeSearchStats(ctx.stats, taskCtx->stats);
+			rootScore &score = scores[task.rootIndex];
+			// A skipped reply, or one that failed low, is only known to be at most <value> - it may be lower than every
+			// reply searched, so the move's score is only an upper bound from then on
+			if (!searched || (taskAlpha != noAlpha && value <= taskAlpha))
+				score.isExact = false;
+			if (value < score.value)
+			{
+				score.value = value;
+				score.pv = score.isExact ? principalVariation(*taskCtx, 0) : vector<gameMove>();
+			}
+			if (!score.isExact)
+				score.pv.clear();
+			if (--score.pendingTasks == 0 && score.isExact)
+				raiseAlpha(alpha, score.value);
+		});
+	}
+	// Only this thread can receive stop messages, so it keeps checking for them while the others search
+	if (ctx.pollMessages != nullptr)
+		waitForGroup(group, [&ctx] { checkStop(ctx, timeNow()); }, STOP_POLL_US);
+	else
+		waitForGroup(group);
+
+	vector<valueMove> scoredMoves(moves.size());
+	for (size_t i = 0; i < moves.size(); i++)
+	{
+		scoredMoves[i].move = moves[i];
+		scoredMoves[i].value = scores[i].value;
+		scoredMoves[i].isExact = scores[i].isExact;
+		scoredMoves[i].pv = scores[i].pv;
+	}
+
+	stable_sort(scoredMoves.begin(), scoredMoves.end(), [](const valueMove &left, const valueMove &right)
+	{
+		if (left.isExact != right.isExact) return left.isExact;
+		return left.value > right.value;
+	});
+
+	return scoredMoves;
+}
+
+vector<valueMove> multiPVSearch(searchContext &ctx, const board &state, short maxDepth, int pvCount, bool isMaxTurn)
 {
+	// Searching the likely best moves first sets a high bar for the others early
+	vector<gameMove> moves = ctx.params.useMoveOrdering ? treeSearch(ctx, state, MOVE_ORDER_SEARCH_DEPTH, true, isMaxTurn)
+														: getMoves(state, isMaxTurn);
+	vector<valueMove> scoredMoves(moves.size());
+	vector<int> exactScores; // Descending
+
+	short alpha = SHRT_MIN + 1;
+	short beta = SHRT_MAX - 1;
+
+	for (size_t i = 0; i < moves.size(); i++)
+	{
+		board child = applyMove(state, moves[i], isMaxTurn);
+		scoredMoves[i].move = moves[i];
+
+		if (exactScores.size() < (size_t)pvCount)
+		{
+			scoredMoves[i].value = -negaMax(ctx, child, maxDepth - 1, -beta, -alpha, !isMaxTurn, false, 1);
+		}
+		else
+		{
+			// Can this move beat the K-th best one? If not, we only need to know that
+			short bar = exactScores[pvCount - 1];
+			int value = -negaMax(ctx, child, maxDepth - 1, -(bar + 1), -bar, !isMaxTurn, false, 1);
+			if (value > bar)
+				value = -negaMax(ctx, child, maxDepth - 1, -beta, -bar, !isMaxTurn, false, 1);
+			// The full window search may not confirm the fail high(search instability) - then the score is only a bound too
+			scoredMoves[i].isExact = value > bar;
+			scoredMoves[i].value = value;
+		}
+
+		if (scoredMoves[i].isExact)
+		{
+			updatePV(ctx, 0, moves[i]);
+			scoredMoves[i].pv = principalVariation(ctx, 0);
+			exactScores.insert(upper_bound(exactScores.begin(), exactScores.end(), scoredMoves[i].value, greater<int>()), scoredMoves[i].value);
+		}
+	}
+
+	stable_sort(scoredMoves.begin(), scoredMoves.end(), [](const valueMove &left, const valueMove &right)
+	{
+		if (left.isExact != right.isExact) return left.isExact;
+		return left.value > right.value;
+	});
+
+	return scoredMoves;
+}
+
+int slaveSearch(searchContext &ctx, const board &state, short maxDepth, bool isMaxTurn, int currentDepth, int maxBoards, vector<gameMove> &pv)
+{
+	useContextBoard(ctx);
 	board stateCopy = board(state);
 
 	// Reset the statistics measures
-	_boardsEvaluated = 0;
-	_maxDepthReached = 0;
-	_nodesPruned = 0;
-	_estMaxDepthPruned = 0;
-	_entireSpaceCovered = true;
+	startSearch(ctx, maxBoards);
 
 	short alpha = SHRT_MIN + 1;
-    short beta = SHRT_MAX - 1;
-
-    if(isMaxTurn)
-    {
-        return negaMax(stateCopy, maxDepth - currentDepth, alpha, beta, isMaxTurn, false);
-    }
-    else
-    {
-        return -negaMax(stateCopy, maxDepth - currentDepth, -beta, -alpha, isMaxTurn, false);
-    }
-}
\ No newline at end of file
+	short beta = SHRT_MAX - 1;
+
+	// Split the job between the process' threads - the pool's tasks take the moves from the job's node
+	if (canSplitRoot(ctx.params) && maxDepth - currentDepth >= 2 && getMoves(stateCopy, isMaxTurn).size() > 0)
+	{
+		vector<valueMove> scoredMoves = parallelRootSearch(ctx, stateCopy, maxDepth - currentDepth, ctx.params.threads, isMaxTurn);
+		pv = scoredMoves[0].pv;
+		flushBoards(ctx);
+		if (ctx.sharedTable != nullptr) flushDistributed(*ctx.sharedTable);
+		return isMaxTurn ? scoredMoves[0].value : -scoredMoves[0].value;
+	}
+
+	int score = negaMax(ctx, stateCopy, maxDepth - currentDepth, isMaxTurn ? alpha : -beta, isMaxTurn ? beta : -alpha, isMaxTurn, false);
+	pv = principalVariation(ctx, 0);
+	flushBoards(ctx);
+	if (ctx.sharedTable != nullptr) flushDistributed(*ctx.sharedTable);
+
+	return isMaxTurn ? score : -score;
+}
+
+int slaveSearch(const board &state, short maxDepth, bool isMaxTurn, int currentDepth, int maxBoards, vector<gameMove> &pv)
+{
+	return slaveSearch(loadGlobalContext(), state, maxDepth, isMaxTurn, currentDepth, maxBoards, pv);
+}
@@ -8,21 +8,52 @@
 #include "board.h"
 #include "evaluate.h"
 #include "timing.h"
+#include "context.h"
 
-struct valueMove
-{
-	int value;
-	gameMove move;
-};
+#define MOVE_ORDER_SEARCH_DEPTH 2
+// A parallel root search hands out the replies to the root moves when there are fewer root moves than this per thread
+#define ROOT_SPLIT_TASKS_PER_THREAD 2
+
+// The principal variation last found by <ctx> from the node at <ply>
+vector<gameMove> principalVariation(const searchContext &ctx, short ply);
 
 /*
+Search for the best move in <ctx>
 Returns the next best moves in descending order(best to worst)
 state - the current board state
 maxDepth - maximmum depth for the search
 isProbe - is this a shallow probe, used to estimate the next best moves
+For full searches the scored moves are also left in ctx.rootMoves
 */
+vector<gameMove> treeSearch(searchContext &ctx, const board &state, short maxDepth, bool isProbe, bool isMaxTurn);
+
+// The same, in this thread's global context
 vector<gameMove> treeSearch(const board &state, short maxDepth, bool isProbe, bool isMaxTurn);
 
 
-int slaveSearch(const board &state, short maxDepth, bool isMaxTurn, int currentDepth);
+/*
+Score the root moves, exactly for the best <pvCount> and with an upper bound for the rest
+The first <pvCount> moves are searched with the full window. Every other move is searched with a null window
+around the K-th best exact score so far, and only re-searched if it beats it.
+Returns all moves, the exact ones first, each group in descending order of score for the player to move
+*/
+vector<valueMove> multiPVSearch(searchContext &ctx, const board &state, short maxDepth, int pvCount, bool isMaxTurn);
+
+/*
+Score the root moves on <threadCount> threads of the search pool(0 - one per core)
+Each root move(or each reply to it, if there are few root moves) is a task, handed out largest subtree first to
+the next free thread. Tasks share the best exact score found so far as alpha, so moves that can't beat it get
+only an upper bound. Returns all moves, the exact ones first, each group in descending order of score.
+*/
+vector<valueMove> parallelRootSearch(searchContext &ctx, const board &state, short maxDepth, int threadCount, bool isMaxTurn);
+
+/*
+Search a job sent by the master, returning its score for MAX
+maxBoards - how many boards the job may evaluate
+pv - the expected line of play from <state>
+*/
+int slaveSearch(searchContext &ctx, const board &state, short maxDepth, bool isMaxTurn, int currentDepth, int maxBoards, vector<gameMove> &pv);
+
+// The same, in this thread's global context
+int slaveSearch(const board &state, short maxDepth, bool isMaxTurn, int currentDepth, int maxBoards, vector<gameMove> &pv);
 
@@ -1,34 +1,32 @@
 #include "stats.h"
 #include "general.h"
+#include "context.h"
+#include "trace.h"
 
 void parallelSearchStatsToFile(const vector<vector<slaveStats>> &jobStats, long long totTimeNs, long long seqPartNs)
 {
-    float boardsPerSec;
-    float averageBoardsPerSlave;
-    int boardRange, minBoards = INT_MAX, maxBoards = 0;
-    double jobTimeRange, minJobTime = INT_MAX, maxJobTime = 0, totJobTime = 0;
-    double slaveTimeRange, minSlaveTime = INT_MAX, maxSlaveTime = 0, totSlaveTime = 0;    
+    double boardsPerSec;
+    double averageBoardsPerSlave;
+    long long boardRange, minBoards = LLONG_MAX, maxBoards = 0;
+    double jobTimeRange, minJobTime = DBL_MAX, maxJobTime = 0, totJobTime = 0;
+    double slaveTimeRange, minSlaveTime = DBL_MAX, maxSlaveTime = 0, totSlaveTime = 0;
     double boardSD, totTimeSD, jobTimeSD;
 
-    float seqTimeOverTotal = seqPartNs / (double) totTimeNs;
-
-    int totBoardsEvaluated = 0;
-    int nodesPruned = 0;
-    int totEstPrunedMaxD = 0;
-    long estNodesAtMaxD = pow(AVG_BRANCH_FACTOR, _parameters.maxDepth);
-    float estPruneRatioMaxD;
-    
-
-    vector<int> boardsPerSlaveArr(_slaveCount);
-    vector<long long> jobTimesPerSlaveArr(_slaveCount);
-    vector<long long> totTimesPerSlaveArr(_slaveCount);
-    
+    long long totBoardsEvaluated = 0;
+    long long nodesPruned = 0;
+    long long totEstPrunedMaxD = 0;
+    double estNodesAtMaxD = pow(AVG_BRANCH_FACTOR, _parameters.maxDepth);
+    double estPruneRatioMaxD;
 
+    int slaveCount = jobStats.size();
+    vector<long long> boardsPerSlaveArr(slaveCount);
+    vector<double> jobTimesPerSlaveArr(slaveCount);     // In seconds
+    vector<double> totTimesPerSlaveArr(slaveCount);     // In seconds
 
     // Go over all jobs, aggregate
-    for (int slaveId = 0; slaveId < jobStats.size(); slaveId++)
+    for (int slaveId = 0; slaveId < slaveCount; slaveId++)
     {
-        int boardsForCurrSlave = 0;
+        long long boardsForCurrSlave = 0;
         double jobTimeForCurrSlave = 0;
         double totTimeForCurrSlave = 0;
         
@@ -43,7 +41,7 @@ void parallelSearchStatsToFile(const vector<vector<slaveStats>> &jobStats, long
             totTimeForCurrSlave += (job.jobTime + job.sendTime + job.receiveTime) / BLN_DOUBLE;
         }
 
-        boardsPerSlaveArr[_slaveCount] = boardsForCurrSlave;
+        boardsPerSlaveArr[slaveId] = boardsForCurrSlave;
         maxBoards = max(boardsForCurrSlave, maxBoards);
         minBoards = min(boardsForCurrSlave, minBoards);
         
@@ -60,28 +58,27 @@ void parallelSearchStatsToFile(const vector<vector<slaveStats>> &jobStats, long
 
     // Calculate
     boardsPerSec = totBoardsEvaluated / (totTimeNs / BLN_DOUBLE);
-    estPruneRatioMaxD = totEstPrunedMaxD / (float) estNodesAtMaxD;
+    estPruneRatioMaxD = totEstPrunedMaxD / estNodesAtMaxD;
 
     // Ranges
     boardRange = maxBoards - minBoards;
     jobTimeRange = maxJobTime - minJobTime;
     slaveTimeRange = maxSlaveTime - minSlaveTime;
-    // Stddev
-    averageBoardsPerSlave = totBoardsEvaluated / (float) _slaveCount;
-    int boardSqDiffSum = 0;
-    double jobTimeSqDiffSum = 0, slaveTimeSqDiffSum = 0;
-    double avgJobTime = totJobTime / (double) _slaveCount;
-    double avgTotTime = totSlaveTime / (double) _slaveCount; 
-    for(int slaveId = 0; slaveId < _slaveCount; slaveId++)
+    // Population standard deviations over the slaves
+    averageBoardsPerSlave = totBoardsEvaluated / (double) slaveCount;
+    double boardSqDiffSum = 0, jobTimeSqDiffSum = 0, slaveTimeSqDiffSum = 0;
+    double avgJobTime = totJobTime / slaveCount;
+    double avgTotTime = totSlaveTime / slaveCount;
+    for(int slaveId = 0; slaveId < slaveCount; slaveId++)
     {
         boardSqDiffSum += pow(boardsPerSlaveArr[slaveId] - averageBoardsPerSlave, 2);
         jobTimeSqDiffSum += pow(jobTimesPerSlaveArr[slaveId] - avgJobTime, 2);
         slaveTimeSqDiffSum += pow(totTimesPerSlaveArr[slaveId] - avgTotTime, 2);
     }
 
-    boardSD = sqrt(boardSqDiffSum);
-    jobTimeSD = sqrt(jobTimeSqDiffSum);
-    totTimeSD = sqrt(slaveTimeSqDiffSum);
+    boardSD = sqrt(boardSqDiffSum / slaveCount);
+    jobTimeSD = sqrt(jobTimeSqDiffSum / slaveCount);
+    totTimeSD = sqrt(slaveTimeSqDiffSum / slaveCount);
 
 
     bool fileExists = false;
@@ -112,8 +109,26 @@ void parallelSearchStatsToFile(const vector<vector<slaveStats>> &jobStats, long
 void writeStatsToFile(const vector<vector<slaveStats>> &jobStats)
 {
     bool fileExists = false;
-    if (ifstream(STATS_FILENAME))
+    ifstream infile(STATS_FILENAME);
+    if (infile)
+    {
         fileExists = true;
+        string header;
+        getline(infile, header);
+        infile.close();
+        if (header.compare(STATS_HEADER) != 0)
+        {
+            // Written with other columns - move it aside and start a new file
+            remove(STATS_OLD_FILENAME);
+            if (rename(STATS_FILENAME, STATS_OLD_FILENAME) != 0)
+            {
+                LOG_ERR("Cannot move the stats file with the old columns to " << STATS_OLD_FILENAME);
+                return;
+            }
+            cout << "Moved " << STATS_FILENAME << " with the old columns to " << STATS_OLD_FILENAME << endl;
+            fileExists = false;
+        }
+    }
 
     ofstream outfile(STATS_FILENAME, ios::app | ios::ate); // Append mode, seek to the end of the file
 
@@ -124,7 +139,7 @@ void writeStatsToFile(const vector<vector<slaveStats>> &jobStats)
     }
 
     if (!fileExists) // If we're creating the file now, write the header'
-        outfile << "boardSize, slaveCount, slaveId, sendTime, receiveTime, jobTime, boardsEvaluated, nodesPrunes, estMaxDepthPruned, maxDepthReached, entireSpace" << endl;
+        outfile << STATS_HEADER << endl;
 
     for (int slaveId = 0; slaveId < jobStats.size(); slaveId++)
     {
@@ -132,40 +147,92 @@ void writeStatsToFile(const vector<vector<slaveStats>> &jobStats)
         {
             outfile << _M * _N << ", " << jobStats.size() << ", " << slaveId << ", " << job.sendTime << ", " << job.receiveTime
                     << ", " << job.jobTime << ", " << job.boardsEvaluated << ", " << job.nodesPruned << ", "
-                    << job.estMaxDepthPruned << ", " << job.maxDepthReached << ", " << job.entireSpace << endl;
+                    << job.estMaxDepthPruned << ", " << job.maxDepthReached << ", " << job.entireSpace << ", " << job.idleTime << endl;
         }
     }
 }
 
-void outputStats(const vector<vector<slaveStats>> &jobStats, long long timeNs)
+searchSummary summariseJobStats(const vector<vector<slaveStats>> &jobStats, long long timeNs)
 {
-    int boardsAssesed = 0;
-    int nodesPruned = 0;
-    int estPruneMaxD = 0;
-    int maxDepthReached = 0;
-    bool entireSpace = true;
+    searchSummary summary;
+    summary.timeNs = timeNs;
+    summary.boardsEvaluated = 0;
+    summary.nodesPruned = 0;
+    summary.estMaxDepthPruned = 0;
+    summary.maxDepthReached = 0;
+    summary.entireSpace = true;
+    summary.jobCount = 0;
+    summary.bestMove = {-1, -1};
 
+    double totJobTime = 0, maxJobTime = 0;
     for (int slaveId = 0; slaveId < jobStats.size(); slaveId++)
     {
+        double jobTimeForCurrSlave = 0;
         for (slaveStats job : jobStats[slaveId])
         {
-            boardsAssesed += job.boardsEvaluated;
-            nodesPruned += job.nodesPruned;
-            estPruneMaxD += job.estMaxDepthPruned;
-            if(job.maxDepthReached > maxDepthReached)
-                maxDepthReached = job.maxDepthReached;
+            summary.boardsEvaluated += job.boardsEvaluated;
+            summary.nodesPruned += job.nodesPruned;
+            summary.estMaxDepthPruned += job.estMaxDepthPruned;
+            if(job.maxDepthReached > summary.maxDepthReached)
+                summary.maxDepthReached = job.maxDepthReached;
             if (!job.entireSpace)
-                entireSpace = false;
+                summary.entireSpace = false;
+            summary.jobCount++;
+            jobTimeForCurrSlave += job.jobTime;
+            summary.remoteProbes += job.remoteProbes;
+            summary.remoteHits += job.remoteHits;
+            summary.remoteStores += job.remoteStores;
+            summary.remoteProbeNs += job.remoteProbeNs;
         }
+        totJobTime += jobTimeForCurrSlave;
+        maxJobTime = max(maxJobTime, jobTimeForCurrSlave);
     }
 
-    cout << "Number of boards assesed: " << boardsAssesed << endl;
-    cout << "Number of nodes pruned: " << nodesPruned << endl;
-    cout << "Estimated number of pruned nodes at maxDepth: " << estPruneMaxD << endl;
-    cout << "Depth of boards: " << maxDepthReached << endl;
-    cout << "Entire space: " << entireSpace << endl;
+    summary.loadImbalance = totJobTime > 0 ? maxJobTime / (totJobTime / jobStats.size()) : 1;
+    return summary;
+}
+
+void updateWorkerMetrics(workerMetrics &metrics, const slaveStats &job)
+{
+    metrics.busyTime += job.jobTime;
+    metrics.idleTime += job.idleTime;
+    metrics.commTime += job.sendTime + job.receiveTime;
+    metrics.jobs++;
+    metrics.boardsEvaluated += job.boardsEvaluated;
+}
+
+void printWorkerMetrics(const vector<workerMetrics> &metrics, long long elapsedNs, bool isFinal)
+{
+    cout << "{ \"workerMetrics\": { \"final\": " << (isFinal ? "true" : "false") << ", \"elapsedSec\": " << elapsedNs / BLN_DOUBLE
+         << ", \"workers\": [";
+    for (size_t slaveId = 0; slaveId < metrics.size(); slaveId++)
+    {
+        const workerMetrics &m = metrics[slaveId];
+        double busySec = m.busyTime / BLN_DOUBLE;
+        cout << (slaveId > 0 ? ", " : " ") << "{ \"id\": " << slaveId << ", \"jobs\": " << m.jobs << ", \"boards\": " << m.boardsEvaluated
+             << ", \"busySec\": " << busySec << ", \"idleSec\": " << m.idleTime / BLN_DOUBLE << ", \"commSec\": " << m.commTime / BLN_DOUBLE
+             << ", \"boardsPerSec\": " << (busySec > 0 ? m.boardsEvaluated / busySec : 0) << " }";
+    }
+    cout << " ] } }" << endl;
+}
+
+void outputStats(const vector<vector<slaveStats>> &jobStats, long long timeNs)
+{
+    searchSummary summary = summariseJobStats(jobStats, timeNs);
+
+    cout << "Number of boards assesed: " << summary.boardsEvaluated << endl;
+    cout << "Number of nodes pruned: " << summary.nodesPruned << endl;
+    cout << "Estimated number of pruned nodes at maxDepth: " << summary.estMaxDepthPruned << endl;
+    cout << "Depth of boards: " << summary.maxDepthReached << endl;
+    cout << "Entire space: " << summary.entireSpace << endl;
     cout << "Elapsed time in seconds: " << timeNs / 1000000000.0 << endl;
-    cout << "Boards per second: " << boardsAssesed / (timeNs / 1000000000.0) << endl;
+    cout << "Boards per second: " << summary.boardsEvaluated / (timeNs / 1000000000.0) << endl;
+    if (summary.remoteProbes > 0 || summary.remoteStores > 0)
+    {
+        cout << "Shared hash probes: " << summary.remoteProbes << ", hit rate: " << (summary.remoteProbes > 0 ? (double)summary.remoteHits / summary.remoteProbes : 0)
+             << ", average latency in us: " << (summary.remoteProbes > 0 ? summary.remoteProbeNs / 1000.0 / summary.remoteProbes : 0)
+             << ", stores: " << summary.remoteStores << endl;
+    }
 }
 
 void staticEvalStatsToFile(float totalTimeInSec)
@@ -185,8 +252,13 @@ void staticEvalStatsToFile(float totalTimeInSec)
     if (!fileExists) // If we're creating the file now, write the header'
         outfile << "staticEval, procCount, boardSize, boardsEvaluated, bpsec, totalTime, evaluationTime, commTime, prunedNodes, estPrunedAtMaxD, estPruneRatio" << endl;
 
-        // TODO: Write the actual stats to the file
-    outfile << _parameters.useStaticEvaluation << ", " << _slaveCount + 1 << ", " << _N * _M << ", " << _boardsEvaluated << ", " << _boardsEvaluated / totalTimeInSec
-            << ", " << totalTimeInSec << ", " << _totalEvaluationTime / BLN_DOUBLE << ", " << _parallelEvalCommTime / BLN_DOUBLE << ", " << _nodesPruned << ", "
-            << _estMaxDepthPruned << ", " << _estMaxDepthPruned / (double) pow(AVG_BRANCH_FACTOR, _parameters.maxDepth) << endl; 
+    outfile << _parameters.useStaticEvaluation << ", " << _slaveCount + 1 << ", " << _N * _M << ", " << _searchContext.stats.boardsEvaluated << ", " << _searchContext.stats.boardsEvaluated / totalTimeInSec
+            << ", " << totalTimeInSec << ", ";
+    // The evaluation time is only measured with tracing - NA rather than a 0 that looks like a measurement
+    if (traceEnabled())
+        outfile << _totalEvaluationTime / BLN_DOUBLE;
+    else
+        outfile << "NA";
+    outfile << ", " << _parallelEvalCommTime / BLN_DOUBLE << ", " << _searchContext.stats.nodesPruned << ", "
+            << _searchContext.stats.estMaxDepthPruned << ", " << _searchContext.stats.estMaxDepthPruned / (double) pow(AVG_BRANCH_FACTOR, _parameters.maxDepth) << endl; 
 }
\ No newline at end of file
@@ -1,21 +1,61 @@
 #pragma once
 #include "stdafx.h"
+#include "general.h"
 
 #define STATS_FILENAME "jobStats.csv"
+#define STATS_OLD_FILENAME "jobStats.old.csv"	// A stats file with another header is moved here, so that rows never go under the wrong columns
+#define STATS_HEADER "boardSize, slaveCount, slaveId, sendTime, receiveTime, jobTime, boardsEvaluated, nodesPrunes, estMaxDepthPruned, maxDepthReached, entireSpace, idleTime"
 #define PAR_SEARCH_AGGR_STATS_FILENAME "parSearchAggr.csv"
 #define STATIC_EVAL_STATS_FILENAME "staticEval.csv"
 
 
+// Stats for one job, as measured by the slave that did it. All times are in ns
 struct slaveStats
 {
-    long long sendTime;
-    long long receiveTime;
-    long long jobTime;
+    long long sendTime;     // Sending the result back
+    long long receiveTime;  // Receiving the job
+    long long jobTime;      // Searching
+    long long idleTime;     // Waiting to be told there is more work
     int boardsEvaluated;
     int nodesPruned;
     int estMaxDepthPruned;
     int maxDepthReached;
     bool entireSpace;
+    // Use of the table shared by the slaves
+    int remoteProbes;
+    int remoteHits;
+    int remoteStores;
+    long long remoteProbeNs;
+};
+
+// Running totals for one slave, kept by the master while a search is in progress
+struct workerMetrics
+{
+    long long busyTime = 0;
+    long long idleTime = 0;
+    long long commTime = 0;
+    int jobs = 0;
+    long long boardsEvaluated = 0;
+};
+
+// The outcome and cost of one search, serial or parallel
+struct searchSummary
+{
+    long long timeNs;
+    int boardsEvaluated;
+    int nodesPruned;
+    int estMaxDepthPruned;
+    int maxDepthReached;
+    bool entireSpace;
+    int jobCount;
+    double loadImbalance; // Busiest worker's job time / average job time per worker, 1 when perfectly balanced
+    gameMove bestMove;
+    // Use of the table shared by the slaves
+    long long remoteProbes = 0;
+    long long remoteHits = 0;
+    long long remoteStores = 0;
+    long long remoteProbeNs = 0;
+    int abandonedJobs = 0; // Still running after being told to stop - their slaves are hung and cannot be shut down cleanly
 };
 
 struct staticEvalStats
@@ -30,9 +70,27 @@ struct staticEvalStats
 /*
 * Write the stats received from the slaves to the stats file
 * - info per job
+* - a file written with other columns(like before idleTime was added) is moved to STATS_OLD_FILENAME first
 */
 void writeStatsToFile(const vector<vector<slaveStats>> &jobStats);
 
+/*
+* Aggregate the stats received from the slaves for a search that took <timeNs>
+*/
+searchSummary summariseJobStats(const vector<vector<slaveStats>> &jobStats, long long timeNs);
+
+/*
+* Add the stats of a completed job to the totals of the slave that did it
+*/
+void updateWorkerMetrics(workerMetrics &metrics, const slaveStats &job);
+
+/*
+* Print the per-slave metrics as a single line of JSON, so they can be picked out of the output and parsed
+* elapsedNs - time since the start of the search
+* isFinal - false for a periodic report, true for the one at the end of the search
+*/
+void printWorkerMetrics(const vector<workerMetrics> &metrics, long long elapsedNs, bool isFinal);
+
 /*
 * Aggregate and output data as per spec
 */
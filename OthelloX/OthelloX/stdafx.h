@@ -34,6 +34,8 @@ using namespace std;
 #endif
 #include <vector>
 #include <climits>
+#include <cfloat>
+#include <cstring>
 #include <algorithm>
 #include <iostream>
 #include <chrono>
@@ -45,4 +47,12 @@ using namespace std;
 #include <unordered_map>
 #include <mpi.h>
 #include <queue>
-#include <assert.h>
\ No newline at end of file
+#include <deque>
+#include <assert.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
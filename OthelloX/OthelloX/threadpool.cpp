@@ -0,0 +1,111 @@
+#include "stdafx.h"
+#include "threadpool.h"
+#include "affinity.h"
+
+static unique_ptr<threadPool> _searchPool;
+static mutex _searchPoolLock;
+
+// Run tasks until the pool stops, as worker <index> of the pool
+static void poolWorker(threadPool &pool, int index)
+{
+	// Placed before the thread touches its stack and tables, so that they are on its NUMA node
+	placeWorker(index);
+
+	while (true)
+	{
+		function<void()> task;
+		{
+			unique_lock<mutex> guard(pool.lock);
+			pool.taskReady.wait(guard, [&pool] { return pool.stopping || pool.tasks.size() > 0; });
+			if (pool.tasks.size() == 0) return; // Stopping, and nothing left to run
+			task = move(pool.tasks.front());
+			pool.tasks.pop_front();
+		}
+
+		task();
+	}
+}
+
+threadPool::~threadPool()
+{
+	stopPool(*this);
+}
+
+void startPool(threadPool &pool, int threadCount)
+{
+	if (threadCount <= 0)
+		threadCount = max(1u, thread::hardware_concurrency());
+
+	pool.stopping = false;
+	for (int t = 0; t < threadCount; t++)
+		pool.workers.push_back(thread(poolWorker, ref(pool), t));
+}
+
+void submitTask(threadPool &pool, taskGroup &group, function<void()> task)
+{
+	{
+		lock_guard<mutex> guard(group.lock);
+		group.pending++;
+	}
+
+	taskGroup *taskGroup = &group;
+	function<void()> groupTask = [taskGroup, task]
+	{
+		task();
+		lock_guard<mutex> guard(taskGroup->lock);
+		if (--taskGroup->pending == 0)
+			taskGroup->done.notify_all();
+	};
+
+	{
+		lock_guard<mutex> guard(pool.lock);
+		pool.tasks.push_back(move(groupTask));
+	}
+	pool.taskReady.notify_one();
+}
+
+void waitForGroup(taskGroup &group)
+{
+	unique_lock<mutex> guard(group.lock);
+	group.done.wait(guard, [&group] { return group.pending == 0; });
+}
+
+void waitForGroup(taskGroup &group, function<void()> poll, int pollUs)
+{
+	unique_lock<mutex> guard(group.lock);
+	while (!group.done.wait_for(guard, chrono::microseconds(pollUs), [&group] { return group.pending == 0; }))
+	{
+		// The tasks may need the lock to finish - don't hold it while polling
+		guard.unlock();
+		poll();
+		guard.lock();
+	}
+}
+
+void stopPool(threadPool &pool)
+{
+	{
+		lock_guard<mutex> guard(pool.lock);
+		pool.stopping = true;
+	}
+	pool.taskReady.notify_all();
+	for (thread &worker : pool.workers)
+		worker.join();
+	pool.workers.clear();
+}
+
+threadPool &searchPool(int threadCount)
+{
+	if (threadCount <= 0)
+		threadCount = max(1u, thread::hardware_concurrency());
+
+	lock_guard<mutex> guard(_searchPoolLock);
+	if (_searchPool && (int)_searchPool->workers.size() != threadCount)
+		_searchPool.reset(); // Stops the old workers
+	if (!_searchPool)
+	{
+		_searchPool.reset(new threadPool());
+		startPool(*_searchPool, threadCount);
+	}
+	return *_searchPool;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#endif // !THREADPOOL_H
+
+#include "stdafx.h"
+
+/*
+A fixed set of worker threads taking tasks from a shared queue, in the order they were submitted
+Kept alive between searches, so that a search only pays for queueing its tasks, not for starting threads
+*/
+struct threadPool
+{
+	vector<thread> workers;
+	deque<function<void()>> tasks;
+	bool stopping = false;
+	mutex lock;
+	condition_variable taskReady;	// Signalled when a task is queued or the pool stops
+
+	~threadPool();
+};
+
+// Tasks that are waited for together - several callers can use the same pool, each waiting only for its own tasks
+struct taskGroup
+{
+	int pending = 0;
+	mutex lock;
+	condition_variable done;	// Signalled when the last pending task finishes
+};
+
+// Start <threadCount> workers(0 - one per core)
+void startPool(threadPool &pool, int threadCount);
+
+// Queue <task> to run on one of the workers, as part of <group>
+void submitTask(threadPool &pool, taskGroup &group, function<void()> task);
+
+// Wait until every task of <group> has finished. Must not be called from a task of the same pool.
+void waitForGroup(taskGroup &group);
+
+// As above, calling <poll> every <pollUs> microseconds while waiting
+void waitForGroup(taskGroup &group, function<void()> poll, int pollUs);
+
+// Finish the queued tasks and stop the workers
+void stopPool(threadPool &pool);
+
+/*
+The pool shared by the searches of this process, started on first use
+Restarted with a different number of workers if <threadCount> changes - searches running at the same time must ask for the same count
+*/
+threadPool &searchPool(int threadCount);
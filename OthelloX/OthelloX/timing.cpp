@@ -4,6 +4,7 @@
 
 static timePoint _start;
 static bool _running = false;
+static timePoint _deadline = timePoint::max();
 
 void startTimer()
 {
@@ -23,6 +24,16 @@ float secondsElapsed()
 	return duration_cast<duration<float>>(time - _start).count();
 }
 
+timePoint timerStart()
+{
+	return _start;
+}
+
+float secondsSince(timePoint start)
+{
+	return duration_cast<duration<float>>(high_resolution_clock::now() - start).count();
+}
+
 long long nsElapsed()
 {
 	if (!_running)
@@ -44,4 +55,36 @@ long long nsBetween(timePoint start, timePoint end)
 {
 	long long elapsed = duration_cast<nanoseconds>(end - start).count();
 	return elapsed;
-}
\ No newline at end of file
+}
+
+float moveTimeBudget(float timeout)
+{
+	return timeout - min(timeout * TIME_RESERVE_FRACTION, TIME_RESERVE_MAX_SECONDS);
+}
+
+timePoint deadlineAfter(timePoint start, double seconds)
+{
+	if (seconds >= DEADLINE_NEVER_SECONDS || start == timePoint::max())
+		return timePoint::max();
+	return start + duration_cast<timePoint::duration>(duration<double>(seconds));
+}
+
+double wallSeconds()
+{
+	return duration_cast<duration<double>>(system_clock::now().time_since_epoch()).count();
+}
+
+timePoint fromWallSeconds(double wall)
+{
+	return deadlineAfter(timeNow(), wall - wallSeconds());
+}
+
+void setSearchDeadline(timePoint deadline)
+{
+	_deadline = deadline;
+}
+
+timePoint searchDeadline()
+{
+	return _deadline;
+}
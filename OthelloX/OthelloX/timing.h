@@ -10,12 +10,22 @@
 
 typedef high_resolution_clock::time_point timePoint;
 
+#define TIME_RESERVE_FRACTION 0.05f	// Share of the timeout kept back from the search, for collecting and reporting the result
+#define TIME_RESERVE_MAX_SECONDS 0.5f	// ... but no more than this
+#define DEADLINE_NEVER_SECONDS 1e9		// Timeouts this long never run out
+
 // Start the timer(from zero)
 void startTimer();
 
 // Get the time since the timer started in seconds
 float secondsElapsed();
 
+// Get the time point the timer was started at
+timePoint timerStart();
+
+// Get the time since <start> in seconds
+float secondsSince(timePoint start);
+
 // Get the time since the timer started in nanoseconds
 long long nsElapsed();
 
@@ -24,3 +34,21 @@ timePoint timeNow();
 
 // Get the difference between two time points
 long long nsBetween(timePoint start, timePoint end);
+
+// Seconds a search may use out of <timeout>, keeping some back to report the result in time
+float moveTimeBudget(float timeout);
+
+// The time point <seconds> after <start> - the latest time point, for timeouts too long to ever run out
+timePoint deadlineAfter(timePoint start, double seconds);
+
+// Wall clock time in seconds - unlike time points, comparable between processes(as far as their clocks agree)
+double wallSeconds();
+
+// The time point at <wall> seconds of wall clock time, as given by wallSeconds
+timePoint fromWallSeconds(double wall);
+
+// Set the time the searches of this process must stop by
+void setSearchDeadline(timePoint deadline);
+
+// The time the searches of this process must stop by - never, until it is set
+timePoint searchDeadline();
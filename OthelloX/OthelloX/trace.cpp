@@ -0,0 +1,95 @@
+#include "stdafx.h"
+#include "trace.h"
+#include "general.h"
+
+#ifdef OTHELLO_TRACE
+
+#include <mutex>
+
+static const char *_categoryNames[TRACE_CATEGORY_COUNT] = { "moveGen", "makeMove", "eval", "hash", "comm" };
+
+// All buffers ever created, so that they can be merged at the end
+static vector<traceBuffer *> _traceBuffers;
+static mutex _traceBuffersLock;
+static thread_local traceBuffer *_threadBuffer = nullptr;
+
+// Reference points for converting ticks to ns
+static const unsigned long long _startTicks = traceTicks();
+static const chrono::steady_clock::time_point _startTime = chrono::steady_clock::now();
+
+traceBuffer *threadTraceBuffer()
+{
+    if (_threadBuffer == nullptr)
+    {
+        _threadBuffer = new traceBuffer();
+        lock_guard<mutex> guard(_traceBuffersLock);
+        _threadBuffer->threadId = _traceBuffers.size();
+        _traceBuffers.push_back(_threadBuffer);
+    }
+    return _threadBuffer;
+}
+
+// How many ns does a tick take, measured over the life of the process so far
+double nsPerTick()
+{
+    // Make sure we measure over a long enough interval
+    while (chrono::steady_clock::now() - _startTime < chrono::milliseconds(10));
+
+    unsigned long long ticks = traceTicks() - _startTicks;
+    long long ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - _startTime).count();
+    return ns / (double)ticks;
+}
+
+long long traceTotalNs(traceCategory category)
+{
+    lock_guard<mutex> guard(_traceBuffersLock);
+    unsigned long long ticks = 0;
+    for (traceBuffer *buffer : _traceBuffers)
+        ticks += buffer->ticks[category];
+    return ticks * nsPerTick();
+}
+
+void traceFinish(int processId)
+{
+    double scale = nsPerTick();
+    lock_guard<mutex> guard(_traceBuffersLock);
+
+    // Totals per category and thread
+    cout << "Trace, process " << processId << ": thread, category, count, totalSec, avgNs" << endl;
+    for (traceBuffer *buffer : _traceBuffers)
+    {
+        for (int c = 0; c < TRACE_CATEGORY_COUNT; c++)
+        {
+            if (buffer->count[c] == 0) continue;
+            double ns = buffer->ticks[c] * scale;
+            cout << buffer->threadId << ", " << _categoryNames[c] << ", " << buffer->count[c] << ", " << ns / BLN_DOUBLE
+                 << ", " << ns / buffer->count[c] << endl;
+        }
+    }
+
+    // Events, with timestamps and durations in microseconds
+    stringstream filename;
+    filename << TRACE_FILENAME_PREFIX << "." << processId << ".json";
+    ofstream out(filename.str(), std::ofstream::trunc);
+    if (!out)
+    {
+        LOG_ERR("Cannot open trace file for writing: " << filename.str());
+        return;
+    }
+
+    out << "{ \"traceEvents\": [" << endl;
+    bool first = true;
+    for (traceBuffer *buffer : _traceBuffers)
+    {
+        for (traceEvent ev : buffer->events)
+        {
+            out << (first ? "" : ",\n") << "{ \"name\": \"" << _categoryNames[ev.category] << "\", \"cat\": \"" << _categoryNames[ev.category]
+                << "\", \"ph\": \"X\", \"ts\": " << (ev.start - _startTicks) * scale / 1000.0 << ", \"dur\": " << (ev.end - ev.start) * scale / 1000.0
+                << ", \"pid\": " << processId << ", \"tid\": " << buffer->threadId << " }";
+            first = false;
+        }
+    }
+    out << endl << "] }" << endl;
+}
+
+#endif // OTHELLO_TRACE
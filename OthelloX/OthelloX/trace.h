@@ -0,0 +1,100 @@
+#pragma once
+#ifndef TRACE_H
+#define TRACE_H
+#endif // !TRACE_H
+
+#include "stdafx.h"
+
+/*
+Hot path tracing. Build with TRACE=1(defines OTHELLO_TRACE) to enable it - otherwise TRACE_SCOPE expands
+to nothing and the trace functions are empty, so tracing costs nothing.
+Each scope adds its duration to per-thread totals for its category and, up to TRACE_MAX_EVENTS per thread,
+records an event that can be exported in the Chrome trace event format(chrome://tracing, Perfetto).
+*/
+
+enum traceCategory
+{
+    TRACE_MOVE_GEN,
+    TRACE_MAKE_MOVE,
+    TRACE_EVAL,
+    TRACE_HASH,
+    TRACE_COMM,
+    TRACE_CATEGORY_COUNT
+};
+
+#define TRACE_MAX_EVENTS 1000000
+#define TRACE_FILENAME_PREFIX "trace" // One file per process: trace.<rank>.json
+
+#ifdef OTHELLO_TRACE
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    // Time stamp counter - a few cycles to read, converted to ns using a calibrated rate
+    inline unsigned long long traceTicks() { return __rdtsc(); }
+#else
+    inline unsigned long long traceTicks() { return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count(); }
+#endif
+
+struct traceEvent
+{
+    int category;
+    unsigned long long start;
+    unsigned long long end;
+};
+
+// Everything one thread has traced
+struct traceBuffer
+{
+    int threadId;
+    unsigned long long count[TRACE_CATEGORY_COUNT];
+    unsigned long long ticks[TRACE_CATEGORY_COUNT];
+    vector<traceEvent> events;
+};
+
+// Get the buffer of the calling thread, creating it on first use
+traceBuffer *threadTraceBuffer();
+
+// Times the enclosing scope
+class traceScope
+{
+public:
+    traceScope(traceCategory category) : _category(category), _start(traceTicks()) {}
+    ~traceScope()
+    {
+        unsigned long long end = traceTicks();
+        traceBuffer *buffer = threadTraceBuffer();
+        buffer->count[_category]++;
+        buffer->ticks[_category] += end - _start;
+        if (buffer->events.size() < TRACE_MAX_EVENTS)
+            buffer->events.push_back({ _category, _start, end });
+    }
+
+private:
+    traceCategory _category;
+    unsigned long long _start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(category) traceScope TRACE_CONCAT(_traceScope, __LINE__)(category)
+
+// Is tracing compiled in? The times only it measures(like the total evaluation time) are missing otherwise
+inline bool traceEnabled() { return true; }
+
+// Total time spent in <category> by all threads so far
+long long traceTotalNs(traceCategory category);
+
+/*
+Print the totals per category and thread, and write the recorded events to trace.<processId>.json
+*/
+void traceFinish(int processId);
+
+#else
+
+#define TRACE_SCOPE(category)
+
+inline bool traceEnabled() { return false; }
+inline long long traceTotalNs(traceCategory category) { return 0; }
+inline void traceFinish(int processId) {}
+
+#endif // OTHELLO_TRACE
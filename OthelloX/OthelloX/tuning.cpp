@@ -0,0 +1,294 @@
+#include "stdafx.h"
+#include "tuning.h"
+#include "parsing.h"
+
+#include <thread>
+
+void initSums(leastSquaresSums &sums, int featureCount)
+{
+	sums.xtx = vector<double>(featureCount * featureCount, 0);
+	sums.xty = vector<double>(featureCount, 0);
+	sums.yty = 0;
+	sums.samples = 0;
+}
+
+void addSample(leastSquaresSums &sums, const float *features, int featureCount, double target)
+{
+	for (int i = 0; i < featureCount; i++)
+	{
+		for (int j = 0; j < featureCount; j++)
+			sums.xtx[i * featureCount + j] += features[i] * (double)features[j];
+		sums.xty[i] += features[i] * target;
+	}
+	sums.yty += target * target;
+	sums.samples++;
+}
+
+void mergeSums(leastSquaresSums &into, const leastSquaresSums &from)
+{
+	for (size_t i = 0; i < into.xtx.size(); i++) into.xtx[i] += from.xtx[i];
+	for (size_t i = 0; i < into.xty.size(); i++) into.xty[i] += from.xty[i];
+	into.yty += from.yty;
+	into.samples += from.samples;
+}
+
+// Solve (X^T X + ridge * I) w = X^T y with Gaussian elimination, return false if the system is singular
+bool solveLeastSquares(const leastSquaresSums &sums, int featureCount, vector<double> &weights)
+{
+	vector<vector<double>> a(featureCount, vector<double>(featureCount + 1));
+	for (int i = 0; i < featureCount; i++)
+	{
+		for (int j = 0; j < featureCount; j++)
+			a[i][j] = sums.xtx[i * featureCount + j] / sums.samples;
+		a[i][i] += TUNE_RIDGE;
+		a[i][featureCount] = sums.xty[i] / sums.samples;
+	}
+
+	for (int col = 0; col < featureCount; col++)
+	{
+		// Partial pivoting
+		int pivot = col;
+		for (int row = col + 1; row < featureCount; row++)
+			if (fabs(a[row][col]) > fabs(a[pivot][col])) pivot = row;
+		if (fabs(a[pivot][col]) < 1e-12) return false;
+		swap(a[col], a[pivot]);
+
+		for (int row = 0; row < featureCount; row++)
+		{
+			if (row == col) continue;
+			double factor = a[row][col] / a[col][col];
+			for (int k = col; k <= featureCount; k++)
+				a[row][k] -= factor * a[col][k];
+		}
+	}
+
+	weights = vector<double>(featureCount);
+	for (int i = 0; i < featureCount; i++)
+		weights[i] = a[i][featureCount] / a[i][i];
+	return true;
+}
+
+// Root mean squared error of the fit, computed from the sums without revisiting the data
+double fitError(const leastSquaresSums &sums, int featureCount, const vector<double> &weights)
+{
+	// |y - Xw|^2 = y^T y - 2 w^T X^T y + w^T X^T X w
+	double err = sums.yty;
+	for (int i = 0; i < featureCount; i++)
+	{
+		err -= 2 * weights[i] * sums.xty[i];
+		for (int j = 0; j < featureCount; j++)
+			err += weights[i] * sums.xtx[i * featureCount + j] * weights[j];
+	}
+	return sqrt(max(0.0, err) / sums.samples);
+}
+
+// Parse a dataset line into a board and a result, return false if it is malformed
+bool parseSample(const string &line, board &state, double &result)
+{
+	istringstream is(line);
+	int rows, cols;
+	string squares;
+	if (!(is >> rows >> cols >> squares >> result)) return false;
+	if (rows != _M || cols != _N || (int)squares.size() != _M * _N) return false;
+
+	for (int i = 0; i < _M * _N; i++)
+	{
+		switch (squares[i])
+		{
+			case 'X': boardAssign(state, i, BRD_MAX_DISC); break;
+			case 'O': boardAssign(state, i, BRD_MIN_DISC); break;
+			case '-': boardAssign(state, i, BRD_FREE); break;
+			default: return false;
+		}
+	}
+	return true;
+}
+
+// Evaluate the features for lines [begin, end) of a chunk
+void tuneWorker(const vector<string> &lines, size_t begin, size_t end, int rows, int cols, leastSquaresSums &dynamicSums,
+				leastSquaresSums &staticSums, long long &malformed)
+{
+	setBoardSize(rows, cols);
+	board state;
+	makeEmptyBoard(state);
+	float dynamic[DYNAMIC_FEATURE_COUNT];
+	float stat[STATIC_FEATURE_COUNT];
+
+	for (size_t i = begin; i < end; i++)
+	{
+		double result;
+		if (!parseSample(lines[i], state, result))
+		{
+			malformed++;
+			continue;
+		}
+
+		staticFeatures(state, stat);
+		addSample(staticSums, stat, STATIC_FEATURE_COUNT, result);
+
+		// Final boards are scored by their disc difference, not by the dynamic evaluator
+		int maxMoves = getMoves(state, true).size();
+		int minMoves = getMoves(state, false).size();
+		if (maxMoves + minMoves == 0) continue;
+
+		dynamicFeatures(state, maxMoves, minMoves, dynamic);
+		addSample(dynamicSums, dynamic, DYNAMIC_FEATURE_COUNT, result);
+	}
+}
+
+// Copy <paramsIn> to <paramsOut>, replacing(or appending) the lines for the given keys
+bool writeTunedParams(const char *paramsIn, const char *paramsOut, const vector<pair<string, int>> &values)
+{
+	vector<string> lines;
+	ifstream in(paramsIn);
+	string line;
+	while (getline(in, line))
+		lines.push_back(line);
+	in.close();
+
+	ofstream out(paramsOut, std::ofstream::trunc);
+	if (!out)
+	{
+		LOG_ERR("Cannot open file for writing: " << paramsOut);
+		return false;
+	}
+
+	vector<bool> written(values.size(), false);
+	for (string l : lines)
+	{
+		string key = l.substr(0, l.find(':'));
+		key.erase(0, key.find_first_not_of(" \t"));
+		key.erase(key.find_last_not_of(" \t\r") + 1);
+
+		bool replaced = false;
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			if (key.compare(values[i].first) == 0)
+			{
+				out << values[i].first << " : " << values[i].second << endl;
+				written[i] = replaced = true;
+			}
+		}
+		if (!replaced && l.compare("") != 0) out << l << endl;
+	}
+
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		if (!written[i]) out << values[i].first << " : " << values[i].second << endl;
+	}
+
+	return true;
+}
+
+bool tuneWeights(const char *datasetFile, const char *paramsIn, const char *paramsOut, int threadCount)
+{
+	if (!parseParamsFile(paramsIn, _parameters))
+	{
+		LOG_ERR("Error while parsing parameters file " << paramsIn);
+		return false;
+	}
+
+	ifstream in(datasetFile);
+	if (!in)
+	{
+		LOG_ERR("Cannot open file for reading: " << datasetFile);
+		return false;
+	}
+
+	// The board size is taken from the first position
+	string line;
+	int rows, cols;
+	while (getline(in, line) && line.compare("") == 0);
+	if (!(istringstream(line) >> rows >> cols) || rows < 1 || cols < 1)
+	{
+		LOG_ERR("Cannot read the board size from the dataset: " << line);
+		return false;
+	}
+	setBoardSize(rows, cols);
+
+	if (threadCount <= 0)
+		threadCount = max(1u, thread::hardware_concurrency());
+
+	leastSquaresSums dynamicSums, staticSums;
+	initSums(dynamicSums, DYNAMIC_FEATURE_COUNT);
+	initSums(staticSums, STATIC_FEATURE_COUNT);
+	long long malformed = 0;
+
+	cout << "Tuning on " << _M << "x" << _N << " positions with " << threadCount << " threads" << endl;
+
+	// Stream the dataset in chunks so that only one chunk is held in memory at a time
+	vector<string> chunk;
+	chunk.reserve(TUNE_CHUNK_SIZE);
+	chunk.push_back(line);
+	bool moreData = true;
+	while (moreData)
+	{
+		while (chunk.size() < TUNE_CHUNK_SIZE && (moreData = (bool)getline(in, line)))
+		{
+			if (line.compare("") != 0) chunk.push_back(line);
+		}
+
+		vector<leastSquaresSums> threadDynamic(threadCount), threadStatic(threadCount);
+		vector<long long> threadMalformed(threadCount, 0);
+		vector<thread> workers;
+		size_t perThread = (chunk.size() + threadCount - 1) / threadCount;
+		for (int t = 0; t < threadCount; t++)
+		{
+			initSums(threadDynamic[t], DYNAMIC_FEATURE_COUNT);
+			initSums(threadStatic[t], STATIC_FEATURE_COUNT);
+			size_t begin = min(chunk.size(), t * perThread);
+			size_t end = min(chunk.size(), begin + perThread);
+			workers.push_back(thread(tuneWorker, cref(chunk), begin, end, _M, _N, ref(threadDynamic[t]), ref(threadStatic[t]),
+									 ref(threadMalformed[t])));
+		}
+
+		for (int t = 0; t < threadCount; t++)
+		{
+			workers[t].join();
+			mergeSums(dynamicSums, threadDynamic[t]);
+			mergeSums(staticSums, threadStatic[t]);
+			malformed += threadMalformed[t];
+		}
+
+		chunk.clear();
+	}
+
+	if (malformed > 0)
+		LOG_ERR("Skipped " << malformed << " malformed positions(check the format and that all boards are " << _M << "x" << _N << ")");
+
+	vector<double> dynamicWeights, staticWeights;
+	if (dynamicSums.samples == 0 || !solveLeastSquares(dynamicSums, DYNAMIC_FEATURE_COUNT, dynamicWeights) ||
+		staticSums.samples == 0 || !solveLeastSquares(staticSums, STATIC_FEATURE_COUNT, staticWeights))
+	{
+		LOG_ERR("Not enough varied positions to fit the weights");
+		return false;
+	}
+
+	cout << "Fitted " << dynamicSums.samples << " non-final positions, RMSE " << fitError(dynamicSums, DYNAMIC_FEATURE_COUNT, dynamicWeights)
+		 << " discs for the dynamic evaluator" << endl;
+	cout << "Fitted " << staticSums.samples << " positions, RMSE " << fitError(staticSums, STATIC_FEATURE_COUNT, staticWeights)
+		 << " discs for the static evaluator" << endl;
+
+	// Only the ordering of the evaluations matters, so scale the weights to the range the evaluators expect
+	double absSum = 0, absMax = 0;
+	for (double w : dynamicWeights) absSum += fabs(w);
+	for (double w : staticWeights) absMax = max(absMax, fabs(w));
+	double dynamicScale = absSum > 0 ? TUNE_DYNAMIC_WEIGHT_SUM / absSum : 0;
+	double staticScale = absMax > 0 ? TUNE_STATIC_MAX_WEIGHT / absMax : 0;
+
+	vector<pair<string, int>> values = {
+		{ PRS_PARITY_WEIGHT, (int)lround(dynamicWeights[FEATURE_PARITY] * dynamicScale) },
+		{ PRS_MOBILITY_WEIGHT, (int)lround(dynamicWeights[FEATURE_MOBILITY] * dynamicScale) },
+		{ PRS_STABILITY_WEIGHT, (int)lround(dynamicWeights[FEATURE_STABILITY] * dynamicScale) },
+		{ PRS_CORNER_WEIGHT, (int)lround(staticWeights[SQUARE_CORNER] * staticScale) },
+		{ PRS_X_SQUARE_WEIGHT, (int)lround(staticWeights[SQUARE_X] * staticScale) },
+		{ PRS_C_SQUARE_WEIGHT, (int)lround(staticWeights[SQUARE_C] * staticScale) },
+		{ PRS_EDGE_SQUARE_WEIGHT, (int)lround(staticWeights[SQUARE_EDGE] * staticScale) },
+		{ PRS_INNER_SQUARE_WEIGHT, (int)lround(staticWeights[SQUARE_INNER] * staticScale) }
+	};
+
+	for (auto value : values)
+		cout << value.first << " : " << value.second << endl;
+
+	return writeTunedParams(paramsIn, paramsOut, values);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef TUNING_H
+#define TUNING_H
+#endif // !TUNING_H
+
+#include "stdafx.h"
+#include "general.h"
+#include "board.h"
+#include "evaluate.h"
+
+// Command line mode for the weight tuner
+#define MODE_TUNE "tune"
+
+// How many dataset lines are read into memory at a time
+#define TUNE_CHUNK_SIZE 65536
+// Added to the diagonal of the normal equations to keep them solvable on degenerate datasets
+#define TUNE_RIDGE 1e-6
+// The fitted dynamic weights are scaled so that their absolute values sum up to this(as in the default 30/40/30)
+#define TUNE_DYNAMIC_WEIGHT_SUM 100
+// The fitted static weights are scaled so that the largest one has this absolute value(the default corner weight)
+#define TUNE_STATIC_MAX_WEIGHT 10
+
+// Running sums for a streamed least squares fit of <featureCount> features
+struct leastSquaresSums
+{
+	vector<double> xtx;	// X^T * X, featureCount x featureCount, row-major
+	vector<double> xty;	// X^T * y
+	double yty = 0;
+	long long samples = 0;
+};
+
+/*
+Fit the evaluation weights to a dataset of positions with known outcomes and write a new params file
+datasetFile - one position per line, formatted as:
+	<rows> <columns> <squares> <result>
+	squares - rows * columns characters, row by row: X for a MAX disc, O for a MIN disc, - for an empty square
+	result - the final disc difference(MAX - MIN) the game ended with
+	All positions must be of the same size
+paramsIn - the params file to start from. Lines for the tuned weights are replaced, the rest are copied
+paramsOut - where to write the new params file
+threadCount - how many threads evaluate the features, 0 for one per hardware thread
+returns true if the weights were fitted and written
+*/
+bool tuneWeights(const char *datasetFile, const char *paramsIn, const char *paramsOut, int threadCount);